@@ -0,0 +1,465 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json/json.h>
+
+#include <simple-web-server/client_http.hpp>
+
+#include <greyhound/app.hpp>
+#include <greyhound/configuration.hpp>
+
+// Load generation against the HTTP API.  Unless pointed at an existing server,
+// a server is started in-process.  Each client thread issues a weighted random
+// mix of requests over its own keep-alive connection, and latency, throughput,
+// and byte rates are reported as JSON.
+//
+// Usage: greyhound-bench [options] [-- greyhound arguments]
+//
+// Arguments following "--" configure the in-process server exactly as they
+// would the greyhound executable, for example "-c config.json -p 18080".
+
+namespace greyhound
+{
+namespace bench
+{
+
+namespace
+{
+
+using Client = SimpleWeb::Client<SimpleWeb::HTTP>;
+using Clock = std::chrono::steady_clock;
+
+const std::vector<std::string> opNames {
+    "info", "hierarchy", "read", "read-laz", "read-zstd", "read-lz4", "count"
+};
+
+struct Options
+{
+    // An existing server, as "host:port", rather than an in-process one.
+    std::string server;
+
+    std::string resource = "ellipsoid";
+    std::size_t concurrency = 8;
+    double seconds = 10;
+    double warmupSeconds = 1;
+
+    // If nonzero, the total number of requests to make, rather than running
+    // for a fixed duration.
+    std::size_t requests = 0;
+
+    std::size_t depthBegin = 0;
+    std::size_t depthEnd = 8;
+    uint32_t seed = 42;
+
+    // Relative weights of each operation.
+    std::map<std::string, double> mix {
+        { "info", 1 },
+        { "hierarchy", 1 },
+        { "read", 2 },
+        { "read-laz", 2 },
+        { "count", 1 }
+    };
+
+    // Write results here rather than to stdout.
+    std::string output;
+};
+
+struct Samples
+{
+    std::vector<double> ms;
+    std::size_t errors = 0;
+    uint64_t bytes = 0;
+};
+
+// Results of a single client thread, by operation name.
+using Results = std::map<std::string, Samples>;
+
+void usage()
+{
+    std::cerr <<
+        "Usage: greyhound-bench [options] [-- greyhound arguments]\n"
+        "\t--server <host:port>   Target a running server instead\n"
+        "\t--resource <name>      Resource to query (ellipsoid)\n"
+        "\t--concurrency <n>      Concurrent connections (8)\n"
+        "\t--seconds <s>          Measured duration (10)\n"
+        "\t--warmup <s>           Unmeasured duration beforehand (1)\n"
+        "\t--requests <n>         Total requests, instead of a duration\n"
+        "\t--depthBegin <d>       Start of queried depth range (0)\n"
+        "\t--depthEnd <d>         End of queried depth range (8)\n"
+        "\t--seed <n>             Random seed (42)\n"
+        "\t--mix <op:w,...>       Weighted operations, of " <<
+        "info, hierarchy,\n"
+        "\t                       read, read-laz, read-zstd, " <<
+        "read-lz4, count\n"
+        "\t                       (info:1,hierarchy:1,read:2," <<
+        "read-laz:2,count:1)\n"
+        "\t--output <path>        Write JSON results to a file\n";
+}
+
+std::map<std::string, double> parseMix(const std::string& s)
+{
+    std::map<std::string, double> mix;
+    std::istringstream ss(s);
+    std::string item;
+
+    while (std::getline(ss, item, ','))
+    {
+        const auto colon(item.find(':'));
+        const std::string name(item.substr(0, colon));
+        const double weight(
+                colon == std::string::npos ?
+                    1.0 : std::stod(item.substr(colon + 1)));
+
+        if (std::find(opNames.begin(), opNames.end(), name) == opNames.end())
+        {
+            throw std::runtime_error("Unknown operation: " + name);
+        }
+
+        if (weight > 0) mix[name] = weight;
+    }
+
+    if (mix.empty()) throw std::runtime_error("Empty mix");
+    return mix;
+}
+
+// Splits our own arguments from those following "--", which are forwarded to
+// the in-process server.
+Options parseArgs(int argc, char** argv, std::vector<std::string>& rest)
+{
+    Options options;
+
+    int i(1);
+    for ( ; i < argc; ++i)
+    {
+        const std::string arg(argv[i]);
+        if (arg == "--") { ++i; break; }
+        if (arg == "--help" || arg == "-h") { usage(); std::exit(0); }
+        if (i + 1 >= argc) throw std::runtime_error("Missing value: " + arg);
+
+        const std::string v(argv[++i]);
+
+        if      (arg == "--server") options.server = v;
+        else if (arg == "--resource") options.resource = v;
+        else if (arg == "--concurrency") options.concurrency = std::stoul(v);
+        else if (arg == "--seconds") options.seconds = std::stod(v);
+        else if (arg == "--warmup") options.warmupSeconds = std::stod(v);
+        else if (arg == "--requests") options.requests = std::stoul(v);
+        else if (arg == "--depthBegin") options.depthBegin = std::stoul(v);
+        else if (arg == "--depthEnd") options.depthEnd = std::stoul(v);
+        else if (arg == "--seed") options.seed = std::stoul(v);
+        else if (arg == "--mix") options.mix = parseMix(v);
+        else if (arg == "--output") options.output = v;
+        else throw std::runtime_error("Unknown argument: " + arg);
+    }
+
+    for ( ; i < argc; ++i) rest.push_back(argv[i]);
+
+    options.concurrency = std::max<std::size_t>(options.concurrency, 1);
+    if (options.depthEnd <= options.depthBegin)
+    {
+        throw std::runtime_error("Invalid depth range");
+    }
+
+    return options;
+}
+
+std::string path(const Options& options, const std::string& op)
+{
+    const std::string base("/resource/" + options.resource);
+    const std::string depth(
+            "depthBegin=" + std::to_string(options.depthBegin) +
+            "&depthEnd=" + std::to_string(options.depthEnd));
+
+    if (op == "info") return base + "/info";
+    if (op == "hierarchy") return base + "/hierarchy?" + depth;
+    if (op == "count") return base + "/count?" + depth;
+    if (op == "read") return base + "/read?" + depth;
+    if (op == "read-laz") return base + "/read?" + depth + "&compress=true";
+    if (op == "read-zstd")
+    {
+        return base + "/read?" + depth + "&compress=%22zstd%22";
+    }
+    if (op == "read-lz4")
+    {
+        return base + "/read?" + depth + "&compress=%22lz4%22";
+    }
+    throw std::runtime_error("Unknown operation: " + op);
+}
+
+// Returns the size of the response body, or throws on a failed request.
+std::size_t fetch(Client& client, const std::string& p)
+{
+    auto res(client.request("GET", p));
+    if (res->status_code.compare(0, 1, "2"))
+    {
+        throw std::runtime_error(p + ": " + res->status_code);
+    }
+    return res->content.size();
+}
+
+// Issue requests from a single client thread until the end time, or until the
+// remaining request count is exhausted.
+Results drive(
+        const Options& options,
+        const std::size_t index,
+        const Clock::time_point measureStart,
+        const Clock::time_point end,
+        std::atomic_size_t& remaining)
+{
+    std::unique_ptr<Client> client(new Client(options.server));
+
+    std::vector<std::string> ops;
+    std::vector<double> weights;
+    std::vector<std::string> paths;
+    for (const auto& p : options.mix)
+    {
+        ops.push_back(p.first);
+        weights.push_back(p.second);
+        paths.push_back(path(options, p.first));
+    }
+
+    std::mt19937 engine(options.seed + index);
+    std::discrete_distribution<std::size_t> pick(
+            weights.begin(),
+            weights.end());
+
+    Results results;
+    std::size_t errors(0);
+
+    while (true)
+    {
+        if (options.requests)
+        {
+            // Claim a request without letting the count wrap below zero.
+            std::size_t n(remaining.load());
+            while (n && !remaining.compare_exchange_weak(n, n - 1)) { }
+            if (!n) break;
+        }
+        else if (Clock::now() >= end) break;
+
+        const std::size_t i(pick(engine));
+        const auto start(Clock::now());
+
+        // Requests before the measured period only warm caches.
+        const bool measured(options.requests || start >= measureStart);
+
+        try
+        {
+            const std::size_t bytes(fetch(*client, paths[i]));
+            const std::chrono::duration<double, std::milli> d(
+                    Clock::now() - start);
+
+            if (measured)
+            {
+                Samples& s(results[ops[i]]);
+                s.ms.push_back(d.count());
+                s.bytes += bytes;
+            }
+        }
+        catch (std::exception& e)
+        {
+            if (measured) ++results[ops[i]].errors;
+
+            // Don't flood the output if every request is failing.
+            if (++errors <= 3) std::cerr << "Error: " << e.what() << std::endl;
+
+            // The connection may be unusable after a failure.
+            client.reset(new Client(options.server));
+        }
+    }
+
+    return results;
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0;
+    const std::size_t rank(std::ceil(p * sorted.size()));
+    return sorted[std::min(std::max<std::size_t>(rank, 1), sorted.size()) - 1];
+}
+
+Json::Value summarize(Samples s, const double seconds)
+{
+    std::sort(s.ms.begin(), s.ms.end());
+
+    double total(0);
+    for (const double ms : s.ms) total += ms;
+
+    Json::Value json;
+    json["requests"] = static_cast<Json::UInt64>(s.ms.size());
+    json["errors"] = static_cast<Json::UInt64>(s.errors);
+    json["requestsPerSecond"] = s.ms.size() / seconds;
+    json["bytes"] = static_cast<Json::UInt64>(s.bytes);
+    json["bytesPerSecond"] = s.bytes / seconds;
+    json["latencyMs"]["mean"] = s.ms.empty() ? 0 : total / s.ms.size();
+    json["latencyMs"]["p50"] = percentile(s.ms, 0.5);
+    json["latencyMs"]["p99"] = percentile(s.ms, 0.99);
+    json["latencyMs"]["p999"] = percentile(s.ms, 0.999);
+    json["latencyMs"]["max"] = s.ms.empty() ? 0 : s.ms.back();
+    return json;
+}
+
+// Waits for a server to respond to its readiness check, which includes the
+// completion of any configured prewarming.
+void awaitReady(const std::string& server)
+{
+    const auto end(Clock::now() + std::chrono::seconds(60));
+
+    while (Clock::now() < end)
+    {
+        try
+        {
+            Client client(server);
+            const auto res(client.request("GET", "/ready"));
+            if (!res->status_code.compare(0, 1, "2")) return;
+        }
+        catch (...) { }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    throw std::runtime_error("Server at " + server + " is not ready");
+}
+
+} // unnamed namespace
+
+int benchmark(int argc, char** argv)
+{
+    std::vector<std::string> serverArgs;
+    Options options(parseArgs(argc, argv, serverArgs));
+
+    // Our results are the only thing written to stdout, so that they may be
+    // piped elsewhere.  The server's own output goes to stderr.
+    std::ostream out(std::cout.rdbuf());
+    std::cout.rdbuf(std::cerr.rdbuf());
+
+    std::unique_ptr<App> app;
+    std::thread server;
+
+    if (options.server.empty())
+    {
+        // By default, serve the data from scripts/generate-test-data.sh.
+        std::vector<std::string> args {
+            "greyhound", "-d", GREYHOUND_BENCH_DATA
+        };
+        args.insert(args.end(), serverArgs.begin(), serverArgs.end());
+
+        std::vector<char*> argp;
+        for (auto& a : args) argp.push_back(&a.front());
+
+        Configuration config(argp.size(), argp.data());
+        options.server = "localhost:" +
+            std::to_string(config["http"]["port"].asUInt());
+
+        app.reset(new App(config));
+        server = std::thread([&app]() { app->start(); });
+    }
+
+    awaitReady(options.server);
+
+    // Fail early if the resource is unavailable.
+    {
+        Client client(options.server);
+        fetch(client, path(options, "info"));
+    }
+
+    const auto start(Clock::now());
+    const auto measureStart(
+            start + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(
+                    options.requests ? 0 : options.warmupSeconds)));
+    const auto end(
+            measureStart + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(options.seconds)));
+
+    std::atomic_size_t remaining(options.requests);
+    std::vector<Results> results(options.concurrency);
+    std::vector<std::thread> clients;
+
+    for (std::size_t i(0); i < options.concurrency; ++i)
+    {
+        clients.emplace_back([&, i]()
+        {
+            results[i] = drive(options, i, measureStart, end, remaining);
+        });
+    }
+
+    for (auto& t : clients) t.join();
+
+    const std::chrono::duration<double> elapsed(
+            Clock::now() - (options.requests ? start : measureStart));
+
+    if (app)
+    {
+        app->stop();
+        server.join();
+    }
+
+    Samples all;
+    std::map<std::string, Samples> byOp;
+
+    for (const Results& r : results)
+    {
+        for (const auto& p : r)
+        {
+            for (Samples* s : { &all, &byOp[p.first] })
+            {
+                const auto& ms(p.second.ms);
+                s->ms.insert(s->ms.end(), ms.begin(), ms.end());
+                s->errors += p.second.errors;
+                s->bytes += p.second.bytes;
+            }
+        }
+    }
+
+    Json::Value json;
+    json["server"] = options.server;
+    json["resource"] = options.resource;
+    json["concurrency"] = static_cast<Json::UInt64>(options.concurrency);
+    json["seconds"] = elapsed.count();
+    json["depthBegin"] = static_cast<Json::UInt64>(options.depthBegin);
+    json["depthEnd"] = static_cast<Json::UInt64>(options.depthEnd);
+    json["seed"] = options.seed;
+    for (const auto& p : options.mix) json["mix"][p.first] = p.second;
+
+    json["total"] = summarize(all, elapsed.count());
+    for (const auto& p : byOp)
+    {
+        json["operations"][p.first] = summarize(p.second, elapsed.count());
+    }
+
+    const std::string s(json.toStyledString());
+    if (options.output.size()) std::ofstream(options.output) << s;
+    else out << s << std::flush;
+
+    return all.errors ? 1 : 0;
+}
+
+} // namespace bench
+} // namespace greyhound
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        return greyhound::bench::benchmark(argc, argv);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "greyhound-bench: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
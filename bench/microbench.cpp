@@ -0,0 +1,533 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json/json.h>
+
+#include <pdal/compression/LazPerfCompression.hpp>
+
+#include <entwine/types/schema.hpp>
+
+#include <greyhound/chunker.hpp>
+#include <greyhound/codec.hpp>
+#include <greyhound/defs.hpp>
+#include <greyhound/hierarchy.hpp>
+#include <greyhound/json-stream.hpp>
+#include <greyhound/json.hpp>
+
+// Microbenchmarks of request hot paths, run in isolation against mock request
+// and response types.  Inputs are generated from a fixed seed, and each result
+// reports the time and heap allocation per operation as JSON.
+//
+// Usage: greyhound-microbench [--filter <substring>] [--seconds <s>]
+//                             [--seed <n>]
+
+namespace
+{
+    // Heap allocation counters, updated by our replacement operator new.
+    std::atomic<uint64_t> allocatedBytes(0);
+    std::atomic<uint64_t> allocations(0);
+}
+
+void* operator new(std::size_t size)
+{
+    allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace greyhound
+{
+namespace bench
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+struct Options
+{
+    std::string filter;
+    double seconds = 1;
+    uint32_t seed = 42;
+};
+
+// Runs f repeatedly for at least the configured duration, and reports the
+// cost of each call.  Bytes processed per call, if nonzero, give a rate.
+class Runner
+{
+public:
+    explicit Runner(const Options& options) : m_options(options) { }
+
+    template<typename F>
+    void run(const std::string& name, std::size_t bytesPerOp, F f)
+    {
+        if (name.find(m_options.filter) == std::string::npos) return;
+
+        // Warm up, and find an iteration count that fills our duration.
+        f();
+        std::size_t iterations(1);
+        while (true)
+        {
+            const auto start(Clock::now());
+            for (std::size_t i(0); i < iterations; ++i) f();
+            const std::chrono::duration<double> d(Clock::now() - start);
+
+            if (d.count() >= m_options.seconds / 4 || iterations >= 1 << 24)
+            {
+                const double perOp(d.count() / iterations);
+                iterations = std::max<std::size_t>(
+                        m_options.seconds / std::max(perOp, 1e-9), 1);
+                break;
+            }
+            iterations *= 2;
+        }
+
+        const uint64_t bytesBefore(allocatedBytes);
+        const uint64_t allocsBefore(allocations);
+        const auto start(Clock::now());
+
+        for (std::size_t i(0); i < iterations; ++i) f();
+
+        const std::chrono::duration<double> d(Clock::now() - start);
+        const double seconds(d.count());
+
+        Json::Value result;
+        result["name"] = name;
+        result["iterations"] = static_cast<Json::UInt64>(iterations);
+        result["nsPerOp"] = seconds * 1e9 / iterations;
+        result["bytesPerOp"] =
+            static_cast<double>(allocatedBytes - bytesBefore) / iterations;
+        result["allocsPerOp"] =
+            static_cast<double>(allocations - allocsBefore) / iterations;
+
+        if (bytesPerOp)
+        {
+            result["processedBytesPerOp"] =
+                static_cast<Json::UInt64>(bytesPerOp);
+            result["mbPerSecond"] =
+                bytesPerOp * iterations / seconds / 1024.0 / 1024.0;
+        }
+
+        std::cerr << name << ": " << result["nsPerOp"].asDouble() <<
+            " ns/op" << std::endl;
+        m_results.append(result);
+    }
+
+    const Json::Value& results() const { return m_results; }
+
+private:
+    const Options& m_options;
+    Json::Value m_results = Json::arrayValue;
+};
+
+// Completes sends asynchronously on a single thread, as the server's IO
+// thread would.  Chunker sends while locked, so completing a send from
+// within it would deadlock.
+class Loop
+{
+public:
+    Loop() : m_thread([this]() { work(); }) { }
+
+    ~Loop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_done = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    }
+
+    void post(std::function<void()> f)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tasks.push_back(std::move(f));
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    void work()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true)
+        {
+            m_cv.wait(lock, [this]() { return m_done || !m_tasks.empty(); });
+            if (m_tasks.empty()) return;
+
+            auto f(std::move(m_tasks.front()));
+            m_tasks.pop_front();
+
+            lock.unlock();
+            f();
+            lock.lock();
+        }
+    }
+
+    std::deque<std::function<void()>> m_tasks;
+    bool m_done = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+};
+
+// A response that discards its output.
+class MockRes
+{
+public:
+    explicit MockRes(Loop& loop) : m_loop(loop), m_null(nullptr) { }
+
+    void write(const Headers& headers) { }
+    void write(const char* data, std::size_t size) { m_bytes += size; }
+
+    template<typename T>
+    MockRes& operator<<(const T& t)
+    {
+        m_null << t;
+        return *this;
+    }
+
+    void send(std::function<void(const SimpleWeb::error_code&)> f)
+    {
+        m_loop.post([f]() { f(SimpleWeb::error_code()); });
+    }
+
+    std::size_t bytes() const { return m_bytes; }
+
+private:
+    Loop& m_loop;
+    std::ostream m_null;
+    std::size_t m_bytes = 0;
+};
+
+class MockReq
+{
+public:
+    explicit MockReq(Query query) : m_query(query) { }
+
+    // Like that of the server, this builds a new map for each call.
+    Query parse_query_string() const { return m_query; }
+
+private:
+    const Query m_query;
+};
+
+// A schema typical of a read request, and random points in its layout.
+const entwine::Schema& schema()
+{
+    static const entwine::Schema s(([]()
+    {
+        Json::Value json;
+        for (const std::string name : { "X", "Y", "Z" })
+        {
+            Json::Value dim;
+            dim["name"] = name;
+            dim["type"] = "floating";
+            dim["size"] = 8;
+            json.append(dim);
+        }
+        for (const std::string name : { "Intensity", "Red", "Green", "Blue" })
+        {
+            Json::Value dim;
+            dim["name"] = name;
+            dim["type"] = "unsigned";
+            dim["size"] = 2;
+            json.append(dim);
+        }
+        return json;
+    })());
+    return s;
+}
+
+// Coordinates are clustered rather than uniform, so that compression ratios
+// resemble those of real data.
+Data points(std::mt19937& engine, std::size_t n)
+{
+    std::normal_distribution<double> coord(0, 100);
+    std::uniform_int_distribution<uint16_t> attr(0, 255);
+
+    Data data;
+    data.reserve(n * schema().pointSize());
+
+    auto put([&data](const void* p, std::size_t size)
+    {
+        const char* c(static_cast<const char*>(p));
+        data.insert(data.end(), c, c + size);
+    });
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        for (int d(0); d < 3; ++d)
+        {
+            const double v(std::round(coord(engine) * 100) / 100);
+            put(&v, sizeof(v));
+        }
+        for (int d(0); d < 4; ++d)
+        {
+            const uint16_t v(attr(engine));
+            put(&v, sizeof(v));
+        }
+    }
+
+    return data;
+}
+
+// An entwine-style hierarchy: point counts keyed by octant directions.
+Json::Value hierarchy(std::mt19937& engine, std::size_t depth)
+{
+    static const std::vector<std::string> dirs {
+        "swd", "sed", "nwd", "ned", "swu", "seu", "nwu", "neu"
+    };
+
+    std::uniform_int_distribution<Json::UInt64> count(1, 1 << 20);
+    std::bernoulli_distribution present(0.5);
+
+    Json::Value json;
+    json["n"] = count(engine);
+    if (depth)
+    {
+        for (const auto& dir : dirs)
+        {
+            if (present(engine)) json[dir] = hierarchy(engine, depth - 1);
+        }
+    }
+    return json;
+}
+
+// A files query result over many origin files.
+Json::Value files(std::mt19937& engine, std::size_t n)
+{
+    std::uniform_real_distribution<double> coord(-1000, 1000);
+    std::uniform_int_distribution<Json::UInt64> count(1, 1 << 24);
+
+    Json::Value json;
+    for (std::size_t i(0); i < n; ++i)
+    {
+        Json::Value f;
+        f["path"] = "s3://bucket/path/to/tile-" + std::to_string(i) + ".laz";
+        f["numPoints"] = count(engine);
+        f["status"] = "inserted";
+        for (int d(0); d < 6; ++d) f["bounds"].append(coord(engine));
+        json.append(f);
+    }
+    return json;
+}
+
+Options parseArgs(int argc, char** argv)
+{
+    Options options;
+    for (int i(1); i + 1 < argc; i += 2)
+    {
+        const std::string arg(argv[i]);
+        const std::string v(argv[i + 1]);
+
+        if (arg == "--filter") options.filter = v;
+        else if (arg == "--seconds") options.seconds = std::stod(v);
+        else if (arg == "--seed") options.seed = std::stoul(v);
+        else throw std::runtime_error("Unknown argument: " + arg);
+    }
+    return options;
+}
+
+} // unnamed namespace
+
+int benchmark(int argc, char** argv)
+{
+    const Options options(parseArgs(argc, argv));
+    Runner runner(options);
+    std::mt19937 engine(options.seed);
+
+    // Response streaming, with the chunk sizes our queries produce.
+    {
+        Loop loop;
+        const std::size_t batch(1 << 16);
+        const std::size_t total(1 << 24);
+        const Data payload(points(engine, batch / schema().pointSize()));
+        const Headers headers;
+
+        runner.run("chunker/write", total, [&]()
+        {
+            MockRes res(loop);
+            Chunker<MockRes> chunker(res, headers);
+            Data& data(chunker.data());
+
+            for (std::size_t n(0); n < total; n += payload.size())
+            {
+                data.insert(data.end(), payload.begin(), payload.end());
+                chunker.write();
+            }
+            chunker.write(true);
+        });
+
+        runner.run("chunker/append", total, [&]()
+        {
+            MockRes res(loop);
+            Chunker<MockRes> chunker(res, headers);
+            Data data;
+
+            for (std::size_t n(0); n < total; n += payload.size())
+            {
+                data.assign(payload.begin(), payload.end());
+                chunker.append(data);
+                chunker.write();
+            }
+            chunker.write(true);
+        });
+    }
+
+    // Compression as in Resource::read, of query-sized batches into the
+    // outbound chunk.
+    {
+        const std::size_t batchPoints(4096);
+        const Data data(points(engine, batchPoints * 16));
+        const std::size_t batch(batchPoints * schema().pointSize());
+        const auto dimTypes(schema().pdalLayout().dimTypes());
+
+        runner.run("compress/laz", data.size(), [&]()
+        {
+            Data out;
+            auto sink([&out](const char* p, std::size_t s)
+            {
+                out.insert(out.end(), p, p + s);
+            });
+
+            pdal::LazPerfCompressor compressor(sink, dimTypes);
+            for (std::size_t pos(0); pos < data.size(); pos += batch)
+            {
+                compressor.compress(data.data() + pos, batch);
+            }
+            compressor.done();
+        });
+
+        for (const std::string& name : codec::available())
+        {
+            runner.run("compress/" + name, data.size(), [&]()
+            {
+                Data out;
+                auto sink([&out](const char* p, std::size_t s)
+                {
+                    out.insert(out.end(), p, p + s);
+                });
+
+                auto encoder(Encoder::create(name, sink, 1));
+                for (std::size_t pos(0); pos < data.size(); pos += batch)
+                {
+                    encoder->encode(data.data() + pos, batch);
+                }
+                encoder->done();
+            });
+        }
+    }
+
+    // Serialization of hierarchy and files responses.
+    {
+        const Json::Value h(hierarchy(engine, 6));
+        const Json::Value f(files(engine, 1000));
+
+        std::size_t bytes(0);
+
+        runner.run("json/dense-hierarchy", dense(h).size(), [&]()
+        {
+            bytes += dense(h).size();
+        });
+
+        runner.run("hierarchy/binary", dense(h).size(), [&]()
+        {
+            bytes += hierarchy::toBinary(h).size();
+        });
+
+        runner.run("json/dense-files", dense(f).size(), [&]()
+        {
+            bytes += dense(f).size();
+        });
+
+        // The same serialization, streamed through a bounded buffer.
+        auto stream([&bytes](const Json::Value& json)
+        {
+            JsonStream s([&bytes](const char* pos, std::size_t size)
+            {
+                bytes += size;
+                return true;
+            });
+            s.value(json);
+            s.done();
+        });
+
+        runner.run("json/stream-hierarchy", dense(h).size(), [&]()
+        {
+            stream(h);
+        });
+
+        runner.run("json/stream-files", dense(f).size(), [&]()
+        {
+            stream(f);
+        });
+
+        if (!bytes) throw std::runtime_error("Nothing serialized");
+    }
+
+    // Query parsing, with the parameters of a typical read.
+    {
+        Query query;
+        query.emplace("depthBegin", "8");
+        query.emplace("depthEnd", "12");
+        query.emplace("bounds", "[-500,-500,-100,500,500,100]");
+        query.emplace("schema", dense(schema().toJson()));
+        query.emplace("compress", "true");
+        query.emplace("filter", "{\"Classification\":{\"$in\":[2,6]}}");
+        const MockReq req(query);
+
+        std::size_t members(0);
+        runner.run("query/parse", 0, [&]()
+        {
+            members += parseQuery(req).size();
+        });
+
+        if (!members) throw std::runtime_error("Nothing parsed");
+    }
+
+    Json::Value json;
+    json["seed"] = options.seed;
+    json["results"] = runner.results();
+    std::cout << json.toStyledString() << std::flush;
+
+    return 0;
+}
+
+} // namespace bench
+} // namespace greyhound
+
+int main(int argc, char** argv)
+{
+    try
+    {
+        return greyhound::bench::benchmark(argc, argv);
+    }
+    catch (std::exception& e)
+    {
+        std::cerr << "greyhound-microbench: " << e.what() << std::endl;
+        return 1;
+    }
+}
+
@@ -0,0 +1,23 @@
+# - Find LZ4
+#
+# Find the native LZ4 headers and libraries.  The frame format API, in
+# lz4frame.h, is required.
+#
+#   LZ4_INCLUDE_DIRS    - where to find lz4frame.h.
+#   LZ4_LIBRARIES       - List of libraries when using LZ4.
+#   LZ4_FOUND           - True if LZ4 found.
+
+find_path(LZ4_INCLUDE_DIR NAMES lz4frame.h)
+mark_as_advanced(LZ4_INCLUDE_DIR)
+
+find_library(LZ4_LIBRARY NAMES lz4 liblz4)
+mark_as_advanced(LZ4_LIBRARY)
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LZ4
+                                  REQUIRED_VARS LZ4_LIBRARY LZ4_INCLUDE_DIR)
+
+if(LZ4_FOUND)
+  set(LZ4_LIBRARIES ${LZ4_LIBRARY})
+  set(LZ4_INCLUDE_DIRS ${LZ4_INCLUDE_DIR})
+endif()
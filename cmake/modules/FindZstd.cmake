@@ -0,0 +1,22 @@
+# - Find zstd
+#
+# Find the native zstd headers and libraries.
+#
+#   ZSTD_INCLUDE_DIRS   - where to find zstd.h.
+#   ZSTD_LIBRARIES      - List of libraries when using zstd.
+#   ZSTD_FOUND          - True if zstd found.
+
+find_path(ZSTD_INCLUDE_DIR NAMES zstd.h)
+mark_as_advanced(ZSTD_INCLUDE_DIR)
+
+find_library(ZSTD_LIBRARY NAMES zstd libzstd zstd_static)
+mark_as_advanced(ZSTD_LIBRARY)
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(ZSTD
+                                  REQUIRED_VARS ZSTD_LIBRARY ZSTD_INCLUDE_DIR)
+
+if(ZSTD_FOUND)
+  set(ZSTD_LIBRARIES ${ZSTD_LIBRARY})
+  set(ZSTD_INCLUDE_DIRS ${ZSTD_INCLUDE_DIR})
+endif()
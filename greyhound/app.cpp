@@ -1,6 +1,7 @@
 #include <greyhound/app.hpp>
 
 #include <fstream>
+#include <sstream>
 
 #include <entwine/third/arbiter/arbiter.hpp>
 
@@ -27,6 +28,18 @@ const std::string publicRoot(([]()->std::string
     return "";
 })());
 
+// Our configured headers, with caching disabled for status routes.
+Headers uncached(Headers h)
+{
+    for (auto it(h.begin()); it != h.end(); )
+    {
+        if (it->first == "Cache-Control") it = h.erase(it);
+        else ++it;
+    }
+    h.emplace("Cache-Control", "no-cache");
+    return h;
+}
+
 }
 
 namespace routes
@@ -42,6 +55,9 @@ const std::string count(resourceBase + "/count$");
 const std::string hierarchy(resourceBase + "/hierarchy$");
 const std::string write(resourceBase + "/write$");
 
+const std::string ready("^/ready$");
+const std::string metrics("^/metrics$");
+
 const std::string renderRoot(resourceBase + "/static$");
 const std::string render(resourceBase + "/static/(.*)$");
 
@@ -125,39 +141,68 @@ void App::registerRoutes(Router<S>& r)
     using Req = typename S::Request;
     using Res = typename S::Response;
 
-    r.put(routes::write, [](Resource& resource, Req& req, Res& res)
+    r.put(routes::write, [](Resource& resource, Req& req, Res& res, Timing& t)
+    {
+        resource.write(req, res, t);
+    });
+
+    r.get(routes::info, [](Resource& resource, Req& req, Res& res, Timing& t)
     {
-        resource.write(req, res);
+        resource.info(req, res, t);
     });
 
-    r.get(routes::info, [](Resource& resource, Req& req, Res& res)
+    r.get(
+            routes::hierarchy,
+            [](Resource& resource, Req& req, Res& res, Timing& t)
     {
-        resource.info(req, res);
+        resource.hierarchy(req, res, t);
     });
 
-    r.get(routes::hierarchy, [](Resource& resource, Req& req, Res& res)
+    r.get(routes::read, [](Resource& resource, Req& req, Res& res, Timing& t)
     {
-        resource.hierarchy(req, res);
+        resource.read(req, res, t);
     });
 
-    r.get(routes::read, [](Resource& resource, Req& req, Res& res)
+    r.get(routes::count, [](Resource& resource, Req& req, Res& res, Timing& t)
     {
-        resource.read(req, res);
+        resource.count(req, res, t);
     });
 
-    r.get(routes::count, [](Resource& resource, Req& req, Res& res)
+    r.get(
+            routes::filesRoot,
+            [](Resource& resource, Req& req, Res& res, Timing& t)
     {
-        resource.count(req, res);
+        resource.files(req, res, t);
     });
 
-    r.get(routes::filesRoot, [](Resource& resource, Req& req, Res& res)
+    r.get(routes::files, [](Resource& resource, Req& req, Res& res, Timing& t)
     {
-        resource.files(req, res);
+        resource.files(req, res, t);
     });
 
-    r.get(routes::files, [](Resource& resource, Req& req, Res& res)
+    r.direct("GET", routes::ready, [this](Req& req, Res& res)
     {
-        resource.files(req, res);
+        Headers h(uncached(m_manager.headers()));
+
+        if (m_manager.ready()) res.write(HttpStatusCode::success_ok, "", h);
+        else
+        {
+            res.write(
+                    HttpStatusCode::server_error_service_unavailable,
+                    "Prewarming",
+                    h);
+        }
+    });
+
+    r.direct("GET", routes::metrics, [this](Req& req, Res& res)
+    {
+        std::ostringstream os;
+        m_manager.writeMetrics(os);
+
+        Headers h(uncached(m_manager.headers()));
+        h.emplace("Content-Type", "text/plain; version=0.0.4");
+
+        res.write(HttpStatusCode::success_ok, os.str(), h);
     });
 
     std::cout << "Static serve:\n\t";
@@ -168,7 +213,7 @@ void App::registerRoutes(Router<S>& r)
         return;
     }
 
-    auto render([](Resource& resource, Req& req, Res& res)
+    auto render([](Resource& resource, Req& req, Res& res, Timing& t)
     {
         std::string p(req.path_match[2]);
         if (p.empty()) p = "index.html";
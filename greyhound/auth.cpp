@@ -1,6 +1,8 @@
 #include <greyhound/auth.hpp>
 
+#include <algorithm>
 #include <cctype>
+#include <functional>
 
 #include <entwine/util/json.hpp>
 #include <entwine/util/unique.hpp>
@@ -56,6 +58,8 @@ Cookies parseCookies(Req& req)
     return cookies;
 }
 
+const std::size_t numShards(16);
+
 } // unnamed namespace
 
 Auth::Auth(
@@ -63,59 +67,403 @@ Auth::Auth(
         const std::vector<std::string> cookies,
         const std::vector<std::string> queries,
         const std::size_t good,
-        const std::size_t bad)
+        const std::size_t bad,
+        const std::size_t maxUsers,
+        const std::string batch,
+        Executor& executor)
     : m_ep(ep)
     , m_cookies(cookies)
     , m_queries(queries)
     , m_good(std::max<std::size_t>(good, 60))
     , m_bad(std::max<std::size_t>(bad, 60))
-{ }
+    , m_maxUsers(std::max<std::size_t>(maxUsers, numShards))
+    , m_batch(batch)
+    , m_executor(executor)
+    , m_hits(0)
+    , m_refreshHits(0)
+    , m_misses(0)
+    , m_fetches(0)
+    , m_failures(0)
+    , m_fetchMicros(0)
+    , m_maxFetchMicros(0)
+{
+    for (std::size_t i(0); i < numShards; ++i)
+    {
+        m_shards.emplace_back(new Shard());
+    }
+}
+
+Auth::~Auth()
+{
+    std::unique_lock<std::mutex> lock(m_refreshMutex);
+    m_refreshCv.wait(lock, [this]() { return !m_refreshing; });
+}
+
+template<typename F>
+ArbiterHttpResponse Auth::timed(F f)
+{
+    const auto start(getNow());
+    ++m_fetches;
+
+    try
+    {
+        ArbiterHttpResponse res(f());
+
+        const std::size_t micros(
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    getNow() - start).count());
+
+        m_fetchMicros += micros;
+
+        std::size_t prev(m_maxFetchMicros);
+        while (
+                micros > prev &&
+                !m_maxFetchMicros.compare_exchange_weak(prev, micros))
+        { }
+
+        return res;
+    }
+    catch (...)
+    {
+        ++m_failures;
+        throw;
+    }
+}
+
+HttpStatusCode Auth::fetch(
+        const ResourceName& name,
+        const ArbiterHeaders& headers,
+        const ArbiterQuery& query)
+{
+    return static_cast<HttpStatusCode>(
+            timed([&]() { return m_ep.httpGet(name, headers, query); })
+            .code());
+}
 
 template<typename Req>
-HttpStatusCode Auth::check(const std::string& resource, Req& req)
+std::vector<HttpStatusCode> Auth::check(
+        const std::vector<std::string>& names,
+        Req& req)
 {
     const auto cookies(parseCookies(req));
     const Query inQuery(req.parse_query_string());
 
-    std::string id;
-    for (const auto c : m_cookies)
+    Context c;
+    for (const auto cookie : m_cookies)
     {
-        auto it(cookies.find(c));
+        auto it(cookies.find(cookie));
         const std::string val(it != cookies.end() ? it->second : "");
-        id += val + "-";
+        c.id += val + "-";
     }
     for (const auto q : m_queries)
     {
         auto it(inQuery.find(q));
         const std::string val(it != inQuery.end() ? it->second : "");
-        id += val + "-";
+        c.id += val + "-";
+    }
+
+    c.headers = ArbiterHeaders(req.header.begin(), req.header.end());
+    c.query = ArbiterQuery(inQuery.begin(), inQuery.end());
+
+    std::vector<HttpStatusCode> codes(
+            names.size(),
+            HttpStatusCode::client_error_unauthorized);
+    std::vector<Pending> pending(names.size());
+
+    // Indices of the results we must await, and of those we must fetch.
+    std::vector<std::size_t> awaiting;
+    std::vector<std::size_t> fetching;
+
+    for (std::size_t i(0); i < names.size(); ++i)
+    {
+        if (lookup(c, names[i], codes[i], pending[i])) continue;
+
+        awaiting.push_back(i);
+        if (pending[i].promise) fetching.push_back(i);
+    }
+
+    if (fetching.size()) std::cout << "Authing " << c.id << std::endl;
+
+    // If a batch request fails, fall back to individual requests.
+    if (fetching.size() > 1 && m_batch.size())
+    {
+        if (resolveBatch(c, names, fetching, pending)) fetching.clear();
+    }
+
+    if (fetching.size() == 1)
+    {
+        const std::size_t i(fetching.front());
+        resolve(c, names[i], pending[i]);
+    }
+    else if (fetching.size())
+    {
+        TaskGroup group(m_executor);
+        for (const std::size_t i : fetching)
+        {
+            group.add([this, &c, &names, &pending, i]()
+            {
+                resolve(c, names[i], pending[i]);
+            });
+        }
+        group.wait();
+    }
+
+    for (const std::size_t i : awaiting) codes[i] = pending[i].future.get();
+
+    return codes;
+}
+
+bool Auth::lookup(
+        const Context& c,
+        const ResourceName& name,
+        HttpStatusCode& code,
+        Pending& pending)
+{
+    Shard& s(shard(c.id));
+    std::lock_guard<std::mutex> lock(s.mutex);
+    Entry& e(entry(s, c.id, name));
+
+    if (e.known)
+    {
+        const std::size_t age(secondsSince(e.checked));
+
+        if (age <= refreshAge(e))
+        {
+            ++m_hits;
+            code = e.code;
+            return true;
+        }
+
+        // The configured lifetime is a hard limit, so refresh results before
+        // they expire rather than serving them afterward.
+        if (age <= ttl(e))
+        {
+            ++m_refreshHits;
+            if (!e.refreshing)
+            {
+                e.refreshing = true;
+                refresh(c.id, name, c.headers, c.query);
+            }
+            code = e.code;
+            return true;
+        }
+    }
+
+    ++m_misses;
+
+    if (e.pending.valid())
+    {
+        // Another request is already waiting on the same result.
+        pending.future = e.pending;
+    }
+    else
+    {
+        pending.promise.reset(new std::promise<HttpStatusCode>());
+        pending.future = e.pending = pending.promise->get_future().share();
+    }
+
+    return false;
+}
+
+void Auth::complete(
+        const Context& c,
+        const ResourceName& name,
+        Pending& pending,
+        const HttpStatusCode code)
+{
+    {
+        Shard& s(shard(c.id));
+        std::lock_guard<std::mutex> lock(s.mutex);
+        Entry& e(entry(s, c.id, name));
+        e.code = code;
+        e.checked = getNow();
+        e.known = true;
+        e.pending = std::shared_future<HttpStatusCode>();
     }
 
-    const auto now(getNow());
+    pending.promise->set_value(code);
+}
 
-    std::unique_lock<std::mutex> outerLock(m_mutex);
-    Entry& entry(m_map[id][resource]);
+void Auth::fail(const Context& c, const ResourceName& name, Pending& pending)
+{
+    {
+        Shard& s(shard(c.id));
+        std::lock_guard<std::mutex> lock(s.mutex);
+        entry(s, c.id, name).pending = std::shared_future<HttpStatusCode>();
+    }
 
-    std::unique_lock<std::mutex> lock(entry.mutex());
-    outerLock.unlock();
+    pending.promise->set_exception(std::current_exception());
+}
 
-    if (
-            ( entry.ok() && secondsBetween(entry.checked(), now) > m_good) ||
-            (!entry.ok() && secondsBetween(entry.checked(), now) > m_bad))
+void Auth::resolve(
+        const Context& c,
+        const ResourceName& name,
+        Pending& pending)
+{
+    try
+    {
+        complete(c, name, pending, fetch(name, c.headers, c.query));
+    }
+    catch (...)
     {
-        std::cout << "Authing " << id << std::endl;
-        const ArbiterHeaders h(req.header.begin(), req.header.end());
-        const ArbiterQuery q(inQuery.begin(), inQuery.end());
+        fail(c, name, pending);
+    }
+}
+
+bool Auth::resolveBatch(
+        const Context& c,
+        const std::vector<std::string>& names,
+        const std::vector<std::size_t>& indices,
+        std::vector<Pending>& pending)
+{
+    Json::Value json;
 
-        entry.set(m_ep.httpGet(resource, h, q).code());
+    try
+    {
+        Json::Value list;
+        for (const std::size_t i : indices) list.append(names[i]);
+
+        const std::string body(Json::FastWriter().write(list));
+        const std::vector<char> data(body.begin(), body.end());
+
+        ArbiterHeaders headers(c.headers);
+        headers.erase("Content-Length");
+        headers["Content-Type"] = "application/json";
+
+        const ArbiterHttpResponse res(timed([&]()
+        {
+            return m_ep.httpPost(m_batch, data, headers, c.query);
+        }));
+
+        if (!res.ok())
+        {
+            throw std::runtime_error(
+                    "Batch response code " + std::to_string(res.code()));
+        }
+
+        const std::vector<char> response(res.data());
+        json = entwine::parse(std::string(response.begin(), response.end()));
+        if (!json.isObject())
+        {
+            throw std::runtime_error("Invalid batch response");
+        }
+    }
+    catch (std::exception& e)
+    {
+        std::cout << "Auth batch failed: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Resources omitted from the response are unauthorized.
+    for (const std::size_t i : indices)
+    {
+        const Json::Value& code(json[names[i]]);
+        complete(
+                c,
+                names[i],
+                pending[i],
+                code.isIntegral() ?
+                    static_cast<HttpStatusCode>(code.asInt()) :
+                    HttpStatusCode::client_error_unauthorized);
     }
 
-    return entry.code();
+    return true;
+}
+
+Auth::Shard& Auth::shard(const UserId& id)
+{
+    return *m_shards[std::hash<std::string>()(id) % m_shards.size()];
+}
+
+Auth::Entry& Auth::entry(
+        Shard& shard,
+        const UserId& id,
+        const ResourceName& name)
+{
+    auto it(shard.users.find(id));
+
+    if (it != shard.users.end())
+    {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru);
+    }
+    else
+    {
+        shard.lru.push_front(id);
+        it = shard.users.emplace(id, User()).first;
+        it->second.lru = shard.lru.begin();
+
+        // Users with a request in flight are retained by that request's
+        // future rather than by this cache, so they are safe to evict.
+        const std::size_t maxUsers(m_maxUsers / m_shards.size());
+        while (shard.users.size() > maxUsers)
+        {
+            shard.users.erase(shard.lru.back());
+            shard.lru.pop_back();
+        }
+    }
+
+    return it->second.entries[name];
+}
+
+void Auth::refresh(
+        const UserId& id,
+        const ResourceName& name,
+        const ArbiterHeaders& headers,
+        const ArbiterQuery& query)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_refreshMutex);
+        ++m_refreshing;
+    }
+
+    m_executor.post([this, id, name, headers, query]()
+    {
+        Shard& s(shard(id));
+
+        try
+        {
+            const HttpStatusCode code(fetch(name, headers, query));
+
+            std::lock_guard<std::mutex> lock(s.mutex);
+            Entry& e(entry(s, id, name));
+            e.code = code;
+            e.checked = getNow();
+            e.known = true;
+            e.refreshing = false;
+        }
+        catch (std::exception& e)
+        {
+            std::cout << "Auth refresh failed: " << e.what() << std::endl;
+
+            // Keep serving the result until it expires, and let a later
+            // request retry.
+            std::lock_guard<std::mutex> lock(s.mutex);
+            entry(s, id, name).refreshing = false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_refreshMutex);
+        --m_refreshing;
+        m_refreshCv.notify_all();
+    });
+}
+
+Auth::Stats Auth::stats() const
+{
+    Stats stats;
+    stats.hits = m_hits;
+    stats.refreshing = m_refreshHits;
+    stats.misses = m_misses;
+    stats.fetches = m_fetches;
+    stats.failures = m_failures;
+    stats.fetchSeconds = m_fetchMicros / 1000000.0;
+    stats.maxFetchSeconds = m_maxFetchMicros / 1000000.0;
+    return stats;
 }
 
 std::unique_ptr<Auth> Auth::maybeCreate(
     const Configuration& config,
-    const entwine::arbiter::Arbiter& a)
+    const entwine::arbiter::Arbiter& a,
+    Executor& executor)
 {
     if (config.json().isMember("auth"))
     {
@@ -178,18 +526,30 @@ std::unique_ptr<Auth> Auth::maybeCreate(
                     time["bad"].asDouble() * 60.0 :
                     time.asDouble() * 60.0);
 
+        const std::size_t maxUsers(
+                auth.isMember("cacheUsers") ?
+                    auth["cacheUsers"].asUInt64() :
+                    65536);
+
         return entwine::makeUnique<Auth>(
                 a.getEndpoint(auth["path"].asString()),
                 cookies,
                 queries,
                 good,
-                bad);
+                bad,
+                maxUsers,
+                auth["batch"].asString(),
+                executor);
     }
     else return std::unique_ptr<Auth>();
 }
 
-template HttpStatusCode Auth::check(const std::string&, Http::Request&);
-template HttpStatusCode Auth::check(const std::string&, Https::Request&);
+template std::vector<HttpStatusCode> Auth::check(
+        const std::vector<std::string>&,
+        Http::Request&);
+template std::vector<HttpStatusCode> Auth::check(
+        const std::vector<std::string>&,
+        Https::Request&);
 
 } // namespace greyhound
 
@@ -1,15 +1,29 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include <entwine/third/arbiter/arbiter.hpp>
 
 #include <greyhound/defs.hpp>
 #include <greyhound/configuration.hpp>
+#include <greyhound/executor.hpp>
 
 namespace greyhound
 {
 
+// Authorization against an external server, with results cached per user
+// and resource.  The cache is split into shards by user ID, each bounding its
+// users in LRU order.  A result is never served once it expires, but during
+// the last quarter of its lifetime it is refreshed in the background, so only
+// unknown or expired results delay a request.
 class Auth
 {
 public:
@@ -18,14 +32,32 @@ public:
             std::vector<std::string> cookies,
             std::vector<std::string> queries,
             std::size_t good,
-            std::size_t bad);
+            std::size_t bad,
+            std::size_t maxUsers,
+            std::string batch,
+            Executor& executor);
+
+    // Waits for any background refreshes.
+    ~Auth();
 
     static std::unique_ptr<Auth> maybeCreate(
         const Configuration& config,
-        const entwine::arbiter::Arbiter& a);
+        const entwine::arbiter::Arbiter& a,
+        Executor& executor);
 
     template<typename Req>
-    HttpStatusCode check(const std::string& name, Req& req);
+    HttpStatusCode check(const std::string& name, Req& req)
+    {
+        return check(std::vector<std::string>{ name }, req).front();
+    }
+
+    // Check several resources at once, returning a code for each.  Results
+    // that must be awaited are requested concurrently, or with a single batch
+    // request if a batch path is configured.
+    template<typename Req>
+    std::vector<HttpStatusCode> check(
+            const std::vector<std::string>& names,
+            Req& req);
 
     const std::vector<std::string>& cookies() const { return m_cookies; }
     const std::vector<std::string>& queries() const { return m_queries; }
@@ -33,38 +65,156 @@ public:
     std::string path() const { return m_ep.prefixedRoot(); }
     std::size_t goodSeconds() const { return m_good; }
     std::size_t badSeconds() const { return m_bad; }
+    std::size_t maxUsers() const { return m_maxUsers; }
+    const std::string& batch() const { return m_batch; }
 
-    class Entry
+    struct Stats
     {
-    public:
-        void set(int c)
-        {
-            m_code = static_cast<HttpStatusCode>(c);
-            m_checked = getNow();
-        }
-
-        const TimePoint& checked() const { return m_checked; }
-        HttpStatusCode code() const { return m_code; }
-        bool ok() const { return greyhound::ok(m_code); }
-        std::mutex& mutex() const { return m_mutex; }
-
-    private:
-        HttpStatusCode m_code = HttpStatusCode::client_error_unauthorized;
-        TimePoint m_checked;
-        mutable std::mutex m_mutex;
+        // Results served from the cache, served from the cache while due for
+        // a refresh, and which had to wait on the auth server.
+        std::size_t hits = 0;
+        std::size_t refreshing = 0;
+        std::size_t misses = 0;
+
+        // Requests made to the auth server, those which failed outright, and
+        // their total and maximum latency.
+        std::size_t fetches = 0;
+        std::size_t failures = 0;
+        double fetchSeconds = 0;
+        double maxFetchSeconds = 0;
     };
 
+    Stats stats() const;
+
 private:
+    using UserId = std::string;
+    using ResourceName = std::string;
+
+    struct Entry
+    {
+        HttpStatusCode code = HttpStatusCode::client_error_unauthorized;
+        TimePoint checked;
+        bool known = false;
+        bool refreshing = false;
+
+        // Valid while a request is waiting on the auth server for this entry.
+        std::shared_future<HttpStatusCode> pending;
+    };
+
+    struct User
+    {
+        std::map<ResourceName, Entry> entries;
+        std::list<UserId>::iterator lru;
+    };
+
+    struct Shard
+    {
+        // Most recently used users are at the front.
+        std::list<UserId> lru;
+        std::map<UserId, User> users;
+        std::mutex mutex;
+    };
+
+    // The parts of a request relevant to authorization.
+    struct Context
+    {
+        UserId id;
+        ArbiterHeaders headers;
+        ArbiterQuery query;
+    };
+
+    // A result that must be awaited.  If the promise is set, the caller is
+    // responsible for fetching it, otherwise another request already is.
+    struct Pending
+    {
+        std::shared_future<HttpStatusCode> future;
+        std::unique_ptr<std::promise<HttpStatusCode>> promise;
+    };
+
+    // Returns true if a usable result is cached, possibly scheduling its
+    // refresh.  Otherwise, sets up the pending result.
+    bool lookup(
+            const Context& c,
+            const ResourceName& name,
+            HttpStatusCode& code,
+            Pending& pending);
+
+    // Fulfill a pending result that we are responsible for, with a fetched
+    // code or with the current exception.
+    void complete(
+            const Context& c,
+            const ResourceName& name,
+            Pending& pending,
+            HttpStatusCode code);
+    void fail(const Context& c, const ResourceName& name, Pending& pending);
+
+    // Fetch and complete a single pending result.  Does not throw.
+    void resolve(const Context& c, const ResourceName& name, Pending& pending);
+
+    // Fetch several pending results with one batch request.  Returns false,
+    // leaving them pending, if the batch request fails.
+    bool resolveBatch(
+            const Context& c,
+            const std::vector<std::string>& names,
+            const std::vector<std::size_t>& indices,
+            std::vector<Pending>& pending);
+
+    Shard& shard(const UserId& id);
+
+    // Caller must hold the shard's mutex.  Marks the user as most recently
+    // used, possibly evicting others.
+    Entry& entry(Shard& shard, const UserId& id, const ResourceName& name);
+
+    std::size_t ttl(const Entry& entry) const
+    {
+        return ok(entry.code) ? m_good : m_bad;
+    }
+
+    // The age after which a result is refreshed ahead of its expiry.
+    std::size_t refreshAge(const Entry& entry) const
+    {
+        return ttl(entry) - ttl(entry) / 4;
+    }
+
+    // Request a result from the auth server.  Throws if no response is
+    // received.
+    HttpStatusCode fetch(
+            const ResourceName& name,
+            const ArbiterHeaders& headers,
+            const ArbiterQuery& query);
+
+    // Performs a request to the auth server, tracking its latency.
+    template<typename F> ArbiterHttpResponse timed(F f);
+
+    void refresh(
+            const UserId& id,
+            const ResourceName& name,
+            const ArbiterHeaders& headers,
+            const ArbiterQuery& query);
+
     const entwine::arbiter::Endpoint m_ep;
     std::vector<std::string> m_cookies;
     std::vector<std::string> m_queries;
     const std::size_t m_good;
     const std::size_t m_bad;
-
-    using UserId = std::string;
-    using ResourceName = std::string;
-    std::map<UserId, std::map<ResourceName, Entry>> m_map;
-    mutable std::mutex m_mutex;
+    const std::size_t m_maxUsers;
+    const std::string m_batch;
+
+    Executor& m_executor;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+
+    std::atomic_size_t m_hits;
+    std::atomic_size_t m_refreshHits;
+    std::atomic_size_t m_misses;
+    std::atomic_size_t m_fetches;
+    std::atomic_size_t m_failures;
+    std::atomic_size_t m_fetchMicros;
+    std::atomic_size_t m_maxFetchMicros;
+
+    // Background refreshes that have not yet completed.
+    std::size_t m_refreshing = 0;
+    std::mutex m_refreshMutex;
+    std::condition_variable m_refreshCv;
 };
 
 } // namespace greyhound
@@ -1,14 +1,45 @@
 #pragma once
 
+#include <algorithm>
 #include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <greyhound/defs.hpp>
 
 namespace greyhound
 {
 
+namespace chunking
+{
+    // Bounds for the adaptive chunk size.  Small chunks get the first bytes
+    // to the client quickly, and larger ones reduce per-send overhead once the
+    // client has shown that it is the bottleneck.
+    const std::size_t minBytes(1 << 14);
+    const std::size_t maxBytes(1 << 22);
+    const std::size_t initialBytes(1 << 16);
+
+    // Maximum number of chunks queued or in flight before the producer blocks.
+    const std::size_t maxQueued(3);
+
+    // Maximum number of drained buffers kept for reuse.
+    const std::size_t maxSpare(16);
+}
+
+// Chunked transfer of a response that is produced incrementally.  Sends are
+// pipelined: once a chunk is handed off, the producer may continue filling the
+// next one while the previous chunks drain to the client.  The producer only
+// blocks if the client falls several chunks behind.
+//
+// A chunk is a list of buffers rather than one contiguous buffer, so producers
+// may hand over whole buffers with append() instead of copying them into
+// data().  Sending still copies each buffer once, into the response stream,
+// after which the buffer is recycled back to the producer.
 template<typename Res>
 class Chunker
 {
@@ -17,7 +48,10 @@ public:
         : m_res(res)
         , m_headers(headers)
     {
-        m_headers.emplace("Content-Type", "binary/octet-stream");
+        if (!m_headers.count("Content-Type"))
+        {
+            m_headers.emplace("Content-Type", "binary/octet-stream");
+        }
     }
 
     ~Chunker()
@@ -38,21 +72,31 @@ public:
         {
             std::cout << "~Chunker: unknown error" << std::endl;
         }
+
+        // Pending send callbacks refer to this object.
+        await();
     }
 
     void write(bool last = false)
     {
         if (m_done) throw std::runtime_error("write was called after done");
-        if (!last && m_data.empty()) return;
+        if (!last && !size()) return;
 
         if (!m_headersSent)
         {
             if (last)
             {
-                m_headers.emplace(
-                        "Content-Length",
-                        std::to_string(m_data.size()));
+                m_headers.emplace("Content-Length", std::to_string(size()));
+                for (const auto& t : m_trailers)
+                {
+                    m_headers.emplace(t.first, t.second());
+                }
+                m_bytes = size();
                 m_res.write(m_headers);
+                for (const Data& part : m_parts)
+                {
+                    m_res.write(part.data(), part.size());
+                }
                 m_res.write(m_data.data(), m_data.size());
                 m_done = true;
                 return;
@@ -60,6 +104,15 @@ public:
             else
             {
                 m_headers.emplace("Transfer-Encoding", "chunked");
+                if (!m_trailers.empty())
+                {
+                    std::string names;
+                    for (const auto& t : m_trailers)
+                    {
+                        names += (names.empty() ? "" : ", ") + t.first;
+                    }
+                    m_headers.emplace("Trailer", names);
+                }
                 m_res.write(m_headers);
             }
 
@@ -67,64 +120,251 @@ public:
         }
 
         if (last) done();
-        else if (m_data.size() > 65536) writeChunk();
+        else if (size() >= m_threshold) push(false);
     }
 
+    // Take ownership of a buffer of response data rather than copying it into
+    // data().  The caller receives an empty recycled buffer in exchange, which
+    // retains the capacity of a previously sent one where possible.
+    void append(Data& data)
+    {
+        if (data.empty()) return;
+
+        if (m_data.size())
+        {
+            m_parts.push_back(std::move(m_data));
+            m_data = spare();
+        }
+
+        m_partsBytes += data.size();
+        m_parts.push_back(std::move(data));
+        data = spare();
+    }
+
+    // Write an already-complete response body as a single non-chunked
+    // response.
+    void writeAll(const char* pos, std::size_t size)
+    {
+        if (m_done) throw std::runtime_error("writeAll was called after done");
+        if (m_headersSent)
+        {
+            throw std::runtime_error("writeAll was called after write");
+        }
+
+        m_headers.emplace("Content-Length", std::to_string(size));
+        for (const auto& t : m_trailers) m_headers.emplace(t.first, t.second());
+        m_bytes = size;
+        m_res.write(m_headers);
+        m_res.write(pos, size);
+        m_done = true;
+    }
+
+    // Add a field whose value is evaluated as the response completes, which
+    // must precede any write.  It is sent as a trailer of a chunked response,
+    // or as a header if the response turns out to be written all at once.
+    void trailer(const std::string& name, std::function<std::string()> value)
+    {
+        m_trailers.emplace_back(name, value);
+    }
+
+    // The tail of the chunk under construction, which may be appended to
+    // directly.
     Data& data() { return m_data; }
-    bool canceled() const { return m_ec == SimpleWeb::errc::broken_pipe; }
+
+    bool canceled() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return static_cast<bool>(m_ec);
+    }
+
     bool cancelled() const { return canceled(); }
 
+    // Bytes of response body handed off for sending so far.
+    std::size_t bytes() const { return m_bytes; }
+
+    // Time spent blocked waiting for the client to drain our chunks.
+    double blockedSeconds() const { return m_blockedSeconds; }
+
 private:
+    struct Chunk
+    {
+        std::vector<Data> parts;
+        std::size_t size = 0;
+        bool last = false;
+        std::string trailers;
+    };
+
+    std::size_t size() const { return m_partsBytes + m_data.size(); }
+
+    Data spare()
+    {
+        Data data;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_spare.empty())
+        {
+            data.swap(m_spare.back());
+            m_spare.pop_back();
+        }
+        return data;
+    }
+
     void done()
     {
-        writeChunk(true);
+        push(true);
+
+        const auto start(getNow());
+        await();
+        const std::chrono::duration<double> d(getNow() - start);
+        m_blockedSeconds += d.count();
+
         m_done = true;
     }
 
-    void writeChunk(bool last = false)
+    // Hand off the current data for sending, and swap in a recycled buffer for
+    // the producer to continue with.
+    void push(bool last)
     {
-        if (m_data.size())
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_queue.size() >= chunking::maxQueued)
         {
-            m_res << std::hex << m_data.size() << "\r\n";
-            m_res.write(m_data.data(), m_data.size());
-            m_res << "\r\n";
+            // The client is the bottleneck, so send larger chunks.
+            m_threshold = std::min(m_threshold * 2, chunking::maxBytes);
+
+            const auto start(getNow());
+            m_cv.wait(lock, [this]()
+            {
+                return m_ec || m_queue.size() < chunking::maxQueued;
+            });
+            const std::chrono::duration<double> d(getNow() - start);
+            m_blockedSeconds += d.count();
+        }
+        else if (!m_sending)
+        {
+            // The client is waiting on us, so send smaller chunks.
+            m_threshold = std::max(m_threshold / 2, chunking::minBytes);
+        }
+
+        // Trailer values may be arbitrarily expensive, so evaluate them
+        // unlocked.  Only the producer pushes, so the queue cannot grow.
+        std::string trailers;
+        if (last && !m_ec)
+        {
+            lock.unlock();
+            for (const auto& t : m_trailers)
+            {
+                trailers += t.first + ": " + t.second() + "\r\n";
+            }
+            lock.lock();
+        }
+
+        if (m_ec)
+        {
+            m_parts.clear();
+            m_partsBytes = 0;
+            m_data.clear();
+            m_done = true;
+            return;
+        }
+
+        m_queue.emplace_back();
+        Chunk& chunk(m_queue.back());
+        chunk.size = size();
+        chunk.last = last;
+        chunk.trailers = std::move(trailers);
+        m_bytes += chunk.size;
+
+        if (m_data.size()) m_parts.push_back(std::move(m_data));
+        m_data = Data();
+
+        chunk.parts.swap(m_parts);
+        m_partsBytes = 0;
+
+        if (!m_spare.empty())
+        {
+            m_data.swap(m_spare.back());
+            m_spare.pop_back();
         }
-        if (last) m_res << "0\r\n\r\n";
 
-        flush();
+        if (!m_sending) send();
     }
 
-    void flush()
+    // Caller must hold m_mutex, and the queue must not be empty.  Only one
+    // send is outstanding at a time, so the response stream is never written
+    // while a previous send is draining it.
+    void send()
     {
-        m_sent = false;
-        m_res.send([this](const SimpleWeb::error_code& ec)
+        m_sending = true;
+        Chunk& chunk(m_queue.front());
+
+        if (chunk.size)
         {
+            m_res << std::hex << chunk.size << "\r\n";
+            for (const Data& part : chunk.parts)
             {
-                std::lock_guard<std::mutex> lock(m_mutex);
-                m_ec = ec;
-                m_data.clear();
-                m_sent = true;
+                m_res.write(part.data(), part.size());
             }
-            m_cv.notify_all();
-        });
+            m_res << "\r\n";
+        }
+        if (chunk.last) m_res << "0\r\n" << chunk.trailers << "\r\n";
+
+        // The response stream now holds its own copy, so the parts are free
+        // for reuse without waiting for the send to complete.
+        for (Data& part : chunk.parts)
+        {
+            if (m_spare.size() == chunking::maxSpare) break;
+            part.clear();
+            m_spare.push_back(std::move(part));
+        }
+        chunk.parts.clear();
+
+        m_res.send([this](const SimpleWeb::error_code& ec) { sent(ec); });
+    }
 
+    void sent(const SimpleWeb::error_code& ec)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (ec) m_ec = ec;
+            m_queue.pop_front();
+
+            if (m_ec) m_queue.clear();
+
+            if (m_queue.empty()) m_sending = false;
+            else send();
+        }
+        m_cv.notify_all();
+    }
+
+    void await()
+    {
         std::unique_lock<std::mutex> lock(m_mutex);
-        m_cv.wait(lock, [this]() { return m_sent; });
-        if (canceled()) m_done = true;
+        m_cv.wait(lock, [this]() { return !m_sending; });
     }
 
     Res& m_res;
     Headers m_headers;
 
+    std::vector<Data> m_parts;
+    std::size_t m_partsBytes = 0;
     Data m_data;
+    std::size_t m_threshold = chunking::initialBytes;
+    std::size_t m_bytes = 0;
+    double m_blockedSeconds = 0;
+
+    using Trailer = std::pair<std::string, std::function<std::string()>>;
+    std::vector<Trailer> m_trailers;
 
     SimpleWeb::error_code m_ec;
     bool m_headersSent = false;
     bool m_done = false;
 
+    std::deque<Chunk> m_queue;
+    std::vector<Data> m_spare;
+    bool m_sending = false;
+
     std::condition_variable m_cv;
     mutable std::mutex m_mutex;
-    bool m_sent = false;
 };
 
 } // namespace greyhound
@@ -0,0 +1,380 @@
+#include <greyhound/codec.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <string>
+
+#ifdef GREYHOUND_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef GREYHOUND_LZ4
+#include <lz4frame.h>
+#endif
+
+namespace greyhound
+{
+
+namespace
+{
+
+std::string trim(std::string s)
+{
+    s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](char c) {
+        return !::isspace(c);
+    }));
+
+    s.erase(std::find_if(s.rbegin(), s.rend(), [](char c) {
+        return !::isspace(c);
+    }).base(), s.end());
+
+    return s;
+}
+
+void checkSize(const std::size_t size, const std::size_t maxBytes)
+{
+    if (size > maxBytes)
+    {
+        throw HttpError(
+                HttpStatusCode::client_error_payload_too_large,
+                "Decoded size exceeds " + std::to_string(maxBytes) + " bytes");
+    }
+}
+
+#ifdef GREYHOUND_ZSTD
+void zstdCheck(const std::size_t code)
+{
+    if (ZSTD_isError(code))
+    {
+        throw std::runtime_error(
+                std::string("zstd error: ") + ZSTD_getErrorName(code));
+    }
+}
+
+class ZstdEncoder : public Encoder
+{
+public:
+    ZstdEncoder(Callback cb, int level)
+        : m_cb(cb)
+        , m_ctx(ZSTD_createCCtx(), ZSTD_freeCCtx)
+        , m_out(ZSTD_CStreamOutSize())
+    {
+        if (!m_ctx) throw std::runtime_error("Could not create zstd context");
+        zstdCheck(
+                ZSTD_CCtx_setParameter(
+                    m_ctx.get(),
+                    ZSTD_c_compressionLevel,
+                    level));
+    }
+
+    virtual void encode(const char* data, std::size_t size) override
+    {
+        ZSTD_inBuffer in { data, size, 0 };
+        while (in.pos < in.size) run(in, ZSTD_e_continue);
+    }
+
+    virtual void done() override
+    {
+        ZSTD_inBuffer in { nullptr, 0, 0 };
+        while (run(in, ZSTD_e_end)) { }
+    }
+
+private:
+    // Returns the number of bytes still buffered within the context.
+    std::size_t run(ZSTD_inBuffer& in, ZSTD_EndDirective mode)
+    {
+        ZSTD_outBuffer out { m_out.data(), m_out.size(), 0 };
+        const std::size_t remaining(
+                ZSTD_compressStream2(m_ctx.get(), &out, &in, mode));
+        zstdCheck(remaining);
+        if (out.pos) m_cb(m_out.data(), out.pos);
+        return remaining;
+    }
+
+    Callback m_cb;
+    std::unique_ptr<ZSTD_CCtx, std::size_t(*)(ZSTD_CCtx*)> m_ctx;
+    Data m_out;
+};
+
+Data zstdDecode(const Data& data, const std::size_t maxBytes)
+{
+    std::unique_ptr<ZSTD_DCtx, std::size_t(*)(ZSTD_DCtx*)> ctx(
+            ZSTD_createDCtx(),
+            ZSTD_freeDCtx);
+    if (!ctx) throw std::runtime_error("Could not create zstd context");
+
+    Data result;
+    Data buffer(ZSTD_DStreamOutSize());
+
+    ZSTD_inBuffer in { data.data(), data.size(), 0 };
+    ZSTD_outBuffer out { buffer.data(), buffer.size(), 0 };
+    std::size_t hint(0);
+
+    do
+    {
+        out.pos = 0;
+        hint = ZSTD_decompressStream(ctx.get(), &out, &in);
+        zstdCheck(hint);
+        checkSize(result.size() + out.pos, maxBytes);
+        result.insert(result.end(), buffer.data(), buffer.data() + out.pos);
+    }
+    while (in.pos < in.size || out.pos == out.size);
+
+    if (hint) throw std::runtime_error("Truncated zstd data");
+    return result;
+}
+#endif
+
+#ifdef GREYHOUND_LZ4
+void lz4Check(const std::size_t code)
+{
+    if (LZ4F_isError(code))
+    {
+        throw std::runtime_error(
+                std::string("LZ4 error: ") + LZ4F_getErrorName(code));
+    }
+}
+
+class Lz4Encoder : public Encoder
+{
+public:
+    Lz4Encoder(Callback cb, int level)
+        : m_cb(cb)
+        , m_ctx(nullptr, LZ4F_freeCompressionContext)
+    {
+        LZ4F_cctx* ctx(nullptr);
+        lz4Check(LZ4F_createCompressionContext(&ctx, LZ4F_VERSION));
+        m_ctx.reset(ctx);
+
+        std::memset(&m_prefs, 0, sizeof(m_prefs));
+        m_prefs.compressionLevel = level;
+
+        m_out.resize(LZ4F_HEADER_SIZE_MAX);
+        flush(
+                LZ4F_compressBegin(
+                    m_ctx.get(),
+                    m_out.data(),
+                    m_out.size(),
+                    &m_prefs));
+    }
+
+    virtual void encode(const char* data, std::size_t size) override
+    {
+        m_out.resize(LZ4F_compressBound(size, &m_prefs));
+        flush(
+                LZ4F_compressUpdate(
+                    m_ctx.get(),
+                    m_out.data(),
+                    m_out.size(),
+                    data,
+                    size,
+                    nullptr));
+    }
+
+    virtual void done() override
+    {
+        m_out.resize(LZ4F_compressBound(0, &m_prefs));
+        flush(
+                LZ4F_compressEnd(
+                    m_ctx.get(),
+                    m_out.data(),
+                    m_out.size(),
+                    nullptr));
+    }
+
+private:
+    void flush(const std::size_t size)
+    {
+        lz4Check(size);
+        if (size) m_cb(m_out.data(), size);
+    }
+
+    Callback m_cb;
+    std::unique_ptr<LZ4F_cctx, LZ4F_errorCode_t(*)(LZ4F_cctx*)> m_ctx;
+    LZ4F_preferences_t m_prefs;
+    Data m_out;
+};
+
+Data lz4Decode(const Data& data, const std::size_t maxBytes)
+{
+    LZ4F_dctx* raw(nullptr);
+    lz4Check(LZ4F_createDecompressionContext(&raw, LZ4F_VERSION));
+    std::unique_ptr<LZ4F_dctx, LZ4F_errorCode_t(*)(LZ4F_dctx*)> ctx(
+            raw,
+            LZ4F_freeDecompressionContext);
+
+    Data result;
+    Data buffer(1 << 16);
+
+    const char* pos(data.data());
+    std::size_t remaining(data.size());
+
+    while (true)
+    {
+        std::size_t dstSize(buffer.size());
+        std::size_t srcSize(remaining);
+
+        const std::size_t hint(
+                LZ4F_decompress(
+                    ctx.get(),
+                    buffer.data(),
+                    &dstSize,
+                    pos,
+                    &srcSize,
+                    nullptr));
+        lz4Check(hint);
+
+        checkSize(result.size() + dstSize, maxBytes);
+        result.insert(result.end(), buffer.data(), buffer.data() + dstSize);
+        pos += srcSize;
+        remaining -= srcSize;
+
+        // A zero hint means a frame is complete.  Otherwise, keep going while
+        // there is input left or output still pending.
+        if (!remaining && !hint) break;
+        if (!remaining && dstSize < buffer.size())
+        {
+            throw std::runtime_error("Truncated LZ4 data");
+        }
+    }
+
+    return result;
+}
+#endif
+
+} // unnamed namespace
+
+namespace codec
+{
+
+const std::vector<std::string>& available()
+{
+    static const std::vector<std::string> names(([]()
+    {
+        std::vector<std::string> names;
+#ifdef GREYHOUND_ZSTD
+        names.push_back("zstd");
+#endif
+#ifdef GREYHOUND_LZ4
+        names.push_back("lz4");
+#endif
+        return names;
+    })());
+
+    return names;
+}
+
+bool isAvailable(const std::string& name)
+{
+    const auto& names(available());
+    return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+std::string negotiate(const std::string& accept)
+{
+    // Weights of the listed encodings, where "*" covers any others.
+    std::map<std::string, double> weights;
+
+    std::size_t pos(0);
+    while (pos != std::string::npos)
+    {
+        const std::size_t end(accept.find(',', pos));
+        const std::string item(
+                accept.substr(
+                    pos,
+                    end == std::string::npos ? end : end - pos));
+        pos = end == std::string::npos ? end : end + 1;
+
+        std::size_t semi(item.find(';'));
+        std::string name(trim(item.substr(0, semi)));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (name.empty()) continue;
+
+        double q(1);
+        while (semi != std::string::npos)
+        {
+            const std::size_t next(item.find(';', semi + 1));
+            const std::string param(
+                    trim(
+                        item.substr(
+                            semi + 1,
+                            next == std::string::npos ?
+                                next : next - semi - 1)));
+            semi = next;
+
+            if (param.size() < 2 || (param[0] != 'q' && param[0] != 'Q') ||
+                    param[1] != '=')
+            {
+                continue;
+            }
+
+            // A malformed weight is treated as unacceptable.
+            try { q = std::stod(param.substr(2)); }
+            catch (...) { q = 0; }
+        }
+
+        weights[name] = q;
+    }
+
+    const auto wildcard(weights.find("*"));
+
+    // The highest weight wins, and ties go to our preference.  An explicit
+    // weight of zero means "not acceptable".
+    std::string best;
+    double bestWeight(0);
+
+    for (const auto& name : available())
+    {
+        const auto it(weights.find(name));
+        const double q(
+                it != weights.end() ? it->second :
+                wildcard != weights.end() ? wildcard->second : 0);
+
+        if (q > bestWeight)
+        {
+            best = name;
+            bestWeight = q;
+        }
+    }
+
+    return best;
+}
+
+Data decode(
+        const std::string& name,
+        const Data& data,
+        const std::size_t maxBytes)
+{
+#ifdef GREYHOUND_ZSTD
+    if (name == "zstd") return zstdDecode(data, maxBytes);
+#endif
+#ifdef GREYHOUND_LZ4
+    if (name == "lz4") return lz4Decode(data, maxBytes);
+#endif
+    throw Http400("Compression not available: " + name);
+}
+
+} // namespace codec
+
+std::unique_ptr<Encoder> Encoder::create(
+        const std::string& name,
+        Callback cb,
+        const int level)
+{
+#ifdef GREYHOUND_ZSTD
+    if (name == "zstd")
+    {
+        return std::unique_ptr<Encoder>(new ZstdEncoder(cb, level));
+    }
+#endif
+#ifdef GREYHOUND_LZ4
+    // LZ4 is only used in its fastest mode.
+    if (name == "lz4") return std::unique_ptr<Encoder>(new Lz4Encoder(cb, 0));
+#endif
+    throw Http400("Compression not available: " + name);
+}
+
+} // namespace greyhound
+
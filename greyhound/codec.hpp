@@ -0,0 +1,56 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// General-purpose byte stream codecs, as opposed to the schema-aware laz-perf
+// compression.  These trade compression ratio for far less CPU per point,
+// which is preferable on fast networks.  Codecs are identified by name - "zstd"
+// or "lz4" - and are only available if Greyhound was built with them.
+namespace codec
+{
+    // Names of the codecs available in this build, in order of preference.
+    const std::vector<std::string>& available();
+    bool isAvailable(const std::string& name);
+
+    // Select the codec with the highest weight in an Accept-Encoding style
+    // header value, for example "zstd;q=0.5, lz4", preferring ours in order
+    // among equal weights.  Returns an empty string if none are acceptable.
+    std::string negotiate(const std::string& accept);
+
+    // Decompress a complete buffer.  Throws on invalid or truncated data, or
+    // with a 413 if the result would exceed maxBytes, so that a small payload
+    // cannot inflate without bound.
+    Data decode(
+            const std::string& name,
+            const Data& data,
+            std::size_t maxBytes);
+}
+
+// Streaming compressor.  Compressed output is passed to the callback as it is
+// produced, which may be during any call.
+class Encoder
+{
+public:
+    using Callback = std::function<void(const char*, std::size_t)>;
+
+    virtual ~Encoder() { }
+
+    static std::unique_ptr<Encoder> create(
+            const std::string& name,
+            Callback cb,
+            int level);
+
+    virtual void encode(const char* data, std::size_t size) = 0;
+    virtual void done() = 0;
+};
+
+} // namespace greyhound
+
@@ -13,6 +13,10 @@ Json::Value defaults()
 {
     Json::Value json;
     json["cacheSize"] = "200MB";
+    json["readCacheSize"] = "64MB";
+    json["hierarchyCacheSize"] = "64MB";
+    json["zstdLevel"] = 1;
+    json["writeSizeLimit"] = "256MB";
     json["paths"] = entwine::toJsonArray(
             std::vector<std::string>{
                 "/greyhound", "~/greyhound",
@@ -21,7 +25,15 @@ Json::Value defaults()
             });
     json["tmp"] = entwine::arbiter::fs::getTempPath();
     json["resourceTimeoutMinutes"] = 2;
+    json["missingTimeoutSeconds"] = 60;
+    json["log"]["format"] = "text";
+    json["log"]["sampleRate"] = 1.0;
+    json["prewarm"]["resources"] = Json::arrayValue;
+    json["prewarm"]["depthBegin"] = 0;
+    json["prewarm"]["depthEnd"] = 8;
     json["http"]["port"] = 8080;
+    json["http"]["immutableMaxAge"] = 0;
+    json["http"]["negotiateEncoding"] = false;
 
     Json::Value headers;
     headers["Cache-Control"] = "public, max-age=300";
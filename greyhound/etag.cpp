@@ -0,0 +1,72 @@
+#include <greyhound/etag.hpp>
+
+#include <cstdio>
+
+namespace greyhound
+{
+
+namespace etag
+{
+
+void Digest::update(const char* pos, const std::size_t size)
+{
+    for (const char* end(pos + size); pos != end; ++pos)
+    {
+        m_hash ^= static_cast<unsigned char>(*pos);
+        m_hash *= 1099511628211ull;
+    }
+}
+
+std::string Digest::hex() const
+{
+    char s[17];
+    std::snprintf(
+            s,
+            sizeof(s),
+            "%016llx",
+            static_cast<unsigned long long>(m_hash));
+    return s;
+}
+
+std::string digest(const std::string& data)
+{
+    Digest d;
+    d.update(data.data(), data.size());
+    return d.hex();
+}
+
+std::string make(const std::string& version, const std::string& key)
+{
+    return "\"" + digest(version + '\n' + key) + "\"";
+}
+
+bool matches(const std::string& ifNoneMatch, const std::string& tag)
+{
+    std::size_t pos(0);
+
+    while (pos < ifNoneMatch.size())
+    {
+        std::size_t end(ifNoneMatch.find(',', pos));
+        if (end == std::string::npos) end = ifNoneMatch.size();
+
+        std::size_t b(ifNoneMatch.find_first_not_of(" \t", pos));
+        std::size_t e(ifNoneMatch.find_last_not_of(" \t", end - 1));
+
+        if (b < end && e != std::string::npos && e >= b)
+        {
+            std::string candidate(ifNoneMatch.substr(b, e - b + 1));
+            if (candidate == "*") return true;
+            if (candidate.compare(0, 2, "W/") == 0) candidate.erase(0, 2);
+            if (candidate == tag) return true;
+        }
+
+        pos = end + 1;
+    }
+
+    return false;
+}
+
+} // namespace etag
+
+} // namespace greyhound
+
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace greyhound
+{
+
+namespace etag
+{
+    // A 64-bit FNV-1a hash of the data, as sixteen hex digits.
+    std::string digest(const std::string& data);
+
+    // The same digest, computed incrementally.
+    class Digest
+    {
+    public:
+        void update(const char* pos, std::size_t size);
+        std::string hex() const;
+
+    private:
+        uint64_t m_hash = 14695981039346656037ull;
+    };
+
+    // A strong entity tag for a response, from the version of the data it
+    // was derived from and a canonical description of the request.
+    std::string make(const std::string& version, const std::string& key);
+
+    // True if an If-None-Match field value matches the tag.  Per RFC 7232,
+    // this uses the weak comparison, so "W/" prefixes are ignored.
+    bool matches(const std::string& ifNoneMatch, const std::string& tag);
+
+    // True if the request carries an If-None-Match header matching the tag,
+    // in which case a 304 may be sent in place of the response.
+    template<typename Req>
+    bool notModified(Req& req, const std::string& tag)
+    {
+        const auto range(req.header.equal_range("If-None-Match"));
+        for (auto it(range.first); it != range.second; ++it)
+        {
+            if (matches(it->second, tag)) return true;
+        }
+        return false;
+    }
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,218 @@
+#include <greyhound/executor.hpp>
+
+#include <algorithm>
+#include <iostream>
+
+namespace greyhound
+{
+
+namespace
+{
+    // The executor and queue index of the calling worker thread, if any.
+    thread_local const Executor* currentExecutor(nullptr);
+    thread_local std::size_t currentIndex(0);
+}
+
+Executor::Executor(const std::size_t threads)
+    : m_next(0)
+{
+    const std::size_t n(std::max<std::size_t>(threads, 1));
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        m_queues.emplace_back(new Queue());
+    }
+
+    for (std::size_t i(0); i < n; ++i)
+    {
+        m_threads.emplace_back([this, i]() { work(i); });
+    }
+}
+
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+
+    m_cv.notify_all();
+    for (auto& t : m_threads) t.join();
+}
+
+void Executor::post(Task task)
+{
+    const std::size_t index(
+            currentExecutor == this ?
+                currentIndex :
+                m_next++ % m_queues.size());
+
+    {
+        Queue& queue(*m_queues[index]);
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_pending;
+    }
+
+    m_cv.notify_one();
+}
+
+std::size_t Executor::queued() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pending;
+}
+
+bool Executor::take(const std::size_t index, Task& task)
+{
+    {
+        Queue& own(*m_queues[index]);
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (std::size_t offset(1); offset < m_queues.size(); ++offset)
+    {
+        Queue& other(*m_queues[(index + offset) % m_queues.size()]);
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty())
+        {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Executor::work(const std::size_t index)
+{
+    currentExecutor = this;
+    currentIndex = index;
+
+    Task task;
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this]() { return m_pending || m_done; });
+            if (!m_pending) return;
+
+            // Reserve a task.  Every reservation corresponds to a task that
+            // has already been queued, so one is certain to be found below,
+            // although another worker may take the one we first see.
+            --m_pending;
+        }
+
+        while (!take(index, task)) std::this_thread::yield();
+
+        try
+        {
+            task();
+        }
+        catch (std::exception& e)
+        {
+            std::cout << "Executor task error: " << e.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "Executor task error: unknown" << std::endl;
+        }
+
+        task = Task();
+    }
+}
+
+TaskGroup::~TaskGroup()
+{
+    try
+    {
+        wait();
+    }
+    catch (...) { }
+}
+
+void TaskGroup::add(Executor::Task task)
+{
+    auto item(std::make_shared<Item>(std::move(task)));
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_unclaimed.push_back(item);
+        ++m_outstanding;
+    }
+
+    // If we have already claimed this item from wait(), we may no longer
+    // exist, so only touch the group once the claim succeeds.
+    m_executor.post([this, item]()
+    {
+        if (!item->claimed.exchange(true)) run(*item);
+    });
+}
+
+void TaskGroup::run(Item& item)
+{
+    std::exception_ptr error;
+
+    try
+    {
+        item.task();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    item.task = Executor::Task();
+
+    // Notify while locked, since a waiter may destroy us as soon as it sees
+    // that nothing is outstanding.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (error && !m_error) m_error = error;
+    --m_outstanding;
+    m_cv.notify_all();
+}
+
+void TaskGroup::wait()
+{
+    while (true)
+    {
+        SharedItem item;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_unclaimed.empty()) break;
+
+            // The most recently added tasks are the least likely to have
+            // been started by a worker.
+            item = m_unclaimed.back();
+            m_unclaimed.pop_back();
+        }
+
+        if (!item->claimed.exchange(true)) run(*item);
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this]() { return !m_outstanding; });
+
+    if (m_error)
+    {
+        std::exception_ptr error(m_error);
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace greyhound
+
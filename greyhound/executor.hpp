@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace greyhound
+{
+
+// A long-lived pool of worker threads, so that neither requests nor the work
+// they fan out pay for thread creation.  Each worker owns a queue.  Tasks
+// posted from a worker go to the back of its own queue, and other tasks are
+// distributed round-robin.  Idle workers take from the back of their own queue
+// first, and then steal from the front of others.
+class Executor
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit Executor(std::size_t threads);
+
+    // Runs any tasks already posted, then joins the workers.
+    ~Executor();
+
+    // Errors thrown by the task are logged and discarded.
+    void post(Task task);
+
+    std::size_t threads() const { return m_threads.size(); }
+
+    // The number of posted tasks that no worker has started.
+    std::size_t queued() const;
+
+private:
+    struct Queue
+    {
+        std::deque<Task> tasks;
+        std::mutex mutex;
+    };
+
+    void work(std::size_t index);
+    bool take(std::size_t index, Task& task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::atomic_size_t m_next;
+
+    std::size_t m_pending = 0;
+    bool m_done = false;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    std::vector<std::thread> m_threads;
+};
+
+// A set of tasks that may be awaited together.  While waiting, the calling
+// thread runs any of the group's tasks that no worker has started yet, so
+// waiting from within a task never deadlocks even if every worker is busy.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(Executor& executor) : m_executor(executor) { }
+
+    // Waits for outstanding tasks, discarding any error.
+    ~TaskGroup();
+
+    void add(Executor::Task task);
+
+    // Rethrows the first error from any task in the group.
+    void wait();
+
+private:
+    struct Item
+    {
+        explicit Item(Executor::Task task) : task(task), claimed(false) { }
+
+        Executor::Task task;
+        std::atomic_bool claimed;
+    };
+
+    using SharedItem = std::shared_ptr<Item>;
+
+    void run(Item& item);
+
+    Executor& m_executor;
+
+    std::deque<SharedItem> m_unclaimed;
+    std::size_t m_outstanding = 0;
+    std::exception_ptr m_error;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+};
+
+} // namespace greyhound
+
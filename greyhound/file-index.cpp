@@ -0,0 +1,158 @@
+#include <greyhound/file-index.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <entwine/types/bounds.hpp>
+#include <entwine/types/manifest.hpp>
+
+namespace greyhound
+{
+
+FileIndex::FileIndex(const entwine::Manifest& manifest)
+    : m_files(manifest.fileInfo())
+{
+    struct Item
+    {
+        Box box;
+        entwine::Origin origin;
+        double cx, cy;
+    };
+
+    std::vector<Item> items;
+    items.reserve(m_files.size());
+    m_paths.reserve(m_files.size());
+
+    for (std::size_t i(0); i < m_files.size(); ++i)
+    {
+        const entwine::FileInfo& f(m_files[i]);
+        m_paths.emplace(f.path(), i);
+
+        // Files without bounds cannot overlap anything.
+        if (const entwine::Bounds* b = f.bounds())
+        {
+            const Box box { b->min().x, b->min().y, b->max().x, b->max().y };
+            items.push_back(
+                    Item {
+                        box,
+                        entwine::Origin(i),
+                        box.minx / 2 + box.maxx / 2,
+                        box.miny / 2 + box.maxy / 2
+                    });
+        }
+    }
+
+    // Sort-tile-recursive packing: sort by X into vertical slices of about
+    // sqrt(nodes) leaf nodes each, then sort each slice by Y.
+    const std::size_t n(items.size());
+    const std::size_t leafNodes((n + fanout - 1) / fanout);
+    const std::size_t slices(
+            std::max<std::size_t>(std::ceil(std::sqrt(leafNodes)), 1));
+    const std::size_t sliceSize(
+            ((leafNodes + slices - 1) / slices) * fanout);
+
+    std::sort(
+            items.begin(),
+            items.end(),
+            [](const Item& a, const Item& b) { return a.cx < b.cx; });
+
+    for (std::size_t begin(0); begin < n; begin += sliceSize)
+    {
+        const std::size_t end(std::min(begin + sliceSize, n));
+        std::sort(
+                items.begin() + begin,
+                items.begin() + end,
+                [](const Item& a, const Item& b) { return a.cy < b.cy; });
+    }
+
+    m_boxes.reserve(n + n / (fanout - 1) + 1);
+    m_origins.reserve(n);
+    for (const Item& item : items)
+    {
+        m_boxes.push_back(item.box);
+        m_origins.push_back(item.origin);
+    }
+
+    // Pack each level into the one above it until only the root remains.
+    m_levels.push_back(0);
+    std::size_t begin(0);
+    std::size_t count(n);
+
+    while (count > 1)
+    {
+        const std::size_t end(begin + count);
+        for (std::size_t i(begin); i < end; i += fanout)
+        {
+            Box box(m_boxes[i]);
+            for (std::size_t j(i + 1); j < std::min(i + fanout, end); ++j)
+            {
+                const Box& c(m_boxes[j]);
+                box.minx = std::min(box.minx, c.minx);
+                box.miny = std::min(box.miny, c.miny);
+                box.maxx = std::max(box.maxx, c.maxx);
+                box.maxy = std::max(box.maxy, c.maxy);
+            }
+            m_boxes.push_back(box);
+        }
+
+        begin = end;
+        count = m_boxes.size() - begin;
+        m_levels.push_back(begin);
+    }
+
+    m_levels.push_back(m_boxes.size());
+}
+
+std::vector<entwine::Origin> FileIndex::find(const entwine::Bounds& bounds)
+    const
+{
+    std::vector<entwine::Origin> results;
+    if (m_origins.empty()) return results;
+
+    const Box query {
+        bounds.min().x, bounds.min().y, bounds.max().x, bounds.max().y
+    };
+
+    // Pairs of (level, index within that level), starting from the root.
+    std::vector<std::pair<std::size_t, std::size_t>> stack;
+    stack.emplace_back(m_levels.size() - 2, 0);
+
+    while (!stack.empty())
+    {
+        const std::size_t level(stack.back().first);
+        const std::size_t index(stack.back().second);
+        stack.pop_back();
+
+        if (!m_boxes[m_levels[level] + index].intersects(query)) continue;
+
+        if (!level)
+        {
+            const entwine::Origin origin(m_origins[index]);
+            if (m_files[origin].bounds()->overlaps(bounds))
+            {
+                results.push_back(origin);
+            }
+            continue;
+        }
+
+        const std::size_t size(m_levels[level] - m_levels[level - 1]);
+        const std::size_t begin(index * fanout);
+        const std::size_t end(std::min(begin + fanout, size));
+        for (std::size_t i(begin); i < end; ++i)
+        {
+            stack.emplace_back(level - 1, i);
+        }
+    }
+
+    std::sort(results.begin(), results.end());
+    return results;
+}
+
+const entwine::Origin* FileIndex::find(const std::string& path) const
+{
+    const auto it(m_paths.find(path));
+    return it != m_paths.end() ? &it->second : nullptr;
+}
+
+} // namespace greyhound
+
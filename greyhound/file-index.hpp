@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <entwine/types/file-info.hpp>
+
+namespace entwine
+{
+    class Bounds;
+    class Manifest;
+}
+
+namespace greyhound
+{
+
+// Indexes of a manifest's input files, for /files queries that would
+// otherwise scan the entire manifest: a packed R-tree over their bounds, and a
+// hash of their paths.  Immutable once built.
+class FileIndex
+{
+public:
+    explicit FileIndex(const entwine::Manifest& manifest);
+
+    // Origins of the files whose bounds overlap the query bounds, in origin
+    // order.  The tree is searched for every file whose XY extents intersect
+    // the query, and those candidates are then tested exactly as entwine
+    // tests them, so the result matches a scan of the manifest.
+    std::vector<entwine::Origin> find(const entwine::Bounds& bounds) const;
+
+    // The origin of the file with exactly this path, or null if there is none.
+    const entwine::Origin* find(const std::string& path) const;
+
+    std::size_t size() const { return m_origins.size(); }
+
+private:
+    // Children per node.
+    static const std::size_t fanout = 16;
+
+    struct Box
+    {
+        double minx, miny, maxx, maxy;
+
+        bool intersects(const Box& o) const
+        {
+            return
+                minx <= o.maxx && o.minx <= maxx &&
+                miny <= o.maxy && o.miny <= maxy;
+        }
+    };
+
+    const entwine::FileInfoList& m_files;
+
+    // Nodes are stored level by level from the leaves up, each level packed
+    // contiguously, so that the children of node i of a level are nodes
+    // [i * fanout, (i + 1) * fanout) of the level beneath it.  Leaves are
+    // the files themselves, in sort-tile-recursive order.
+    std::vector<Box> m_boxes;
+    std::vector<std::size_t> m_levels;
+    std::vector<entwine::Origin> m_origins;
+
+    std::unordered_map<std::string, entwine::Origin> m_paths;
+};
+
+} // namespace greyhound
+
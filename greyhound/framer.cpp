@@ -0,0 +1,123 @@
+#include <greyhound/framer.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <pdal/compression/LazPerfCompression.hpp>
+
+#include <entwine/types/schema.hpp>
+
+namespace greyhound
+{
+
+namespace
+{
+    const std::size_t headerSize(sizeof(uint32_t) * 2);
+
+    // The most frames that a single request may have outstanding, so that it
+    // cannot flood the shared executor.
+    const std::size_t maxFrames(8);
+
+    void put(Data& data, std::size_t offset, uint32_t v)
+    {
+        std::memcpy(data.data() + offset, &v, sizeof(uint32_t));
+    }
+}
+
+Framer::Framer(const entwine::Schema& schema, Executor& executor)
+    : m_executor(executor)
+    , m_shared(
+            std::make_shared<Shared>(
+                schema.pdalLayout().dimTypes(),
+                schema.pointSize()))
+    , m_capacity(std::min(executor.threads() * 2, maxFrames))
+{ }
+
+Framer::~Framer()
+{
+    m_shared->canceled = true;
+}
+
+void Framer::push(Data& data)
+{
+    auto slot(std::make_shared<Slot>(data));
+    m_slots.push_back(slot);
+
+    std::shared_ptr<Shared> shared(m_shared);
+    m_executor.post([shared, slot]()
+    {
+        if (shared->canceled || slot->claimed.exchange(true)) return;
+        run(*shared, *slot);
+    });
+}
+
+void Framer::run(Shared& shared, Slot& slot)
+{
+    Data frame(headerSize);
+    std::exception_ptr error;
+
+    try
+    {
+        pdal::LazPerfCompressor compressor(
+                [&frame](char* p, std::size_t s)
+                {
+                    frame.insert(frame.end(), p, p + s);
+                },
+                shared.dimTypes);
+
+        compressor.compress(slot.in.data(), slot.in.size());
+        compressor.done();
+
+        put(frame, 0, slot.in.size() / shared.pointSize);
+        put(frame, sizeof(uint32_t), frame.size() - headerSize);
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+
+    Data().swap(slot.in);
+
+    {
+        std::lock_guard<std::mutex> lock(shared.mutex);
+        slot.data.swap(frame);
+        slot.error = error;
+        slot.done = true;
+    }
+    shared.cv.notify_all();
+}
+
+bool Framer::next(Data& data, const bool wait)
+{
+    if (m_slots.empty()) return false;
+
+    Slot& slot(*m_slots.front());
+
+    // Rather than wait for a worker to reach this frame, compress it here.
+    if (wait && !slot.claimed.exchange(true)) run(*m_shared, slot);
+
+    std::unique_lock<std::mutex> lock(m_shared->mutex);
+    if (wait) m_shared->cv.wait(lock, [&slot]() { return slot.done; });
+    else if (!slot.done) return false;
+
+    if (slot.error) std::rethrow_exception(slot.error);
+
+    data.swap(slot.data);
+    lock.unlock();
+
+    m_slots.pop_front();
+    return true;
+}
+
+bool Framer::full() const
+{
+    return m_slots.size() >= m_capacity;
+}
+
+bool Framer::empty() const
+{
+    return m_slots.empty();
+}
+
+} // namespace greyhound
+
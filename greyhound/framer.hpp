@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+
+#include <pdal/DimType.hpp>
+
+#include <greyhound/defs.hpp>
+#include <greyhound/executor.hpp>
+
+namespace entwine { class Schema; }
+
+namespace greyhound
+{
+
+// Compresses batches of points as independent laz-perf streams on an executor,
+// and hands back the results in the order they were pushed.  Each result is a
+// self-delimiting frame:
+//
+//      uint32_t numPoints      Number of points in this frame.
+//      uint32_t numBytes       Size of the compressed data that follows.
+//      char[numBytes]          A complete laz-perf stream of numPoints points.
+//
+// All integers are little-endian.  Because frames are independent, clients may
+// decompress them concurrently.
+//
+// Compression never blocks, so it runs on the executor for short subtasks.  A
+// frame that no worker has started by the time it is awaited is compressed by
+// the waiting thread instead.  Frames are pushed and taken by a single thread.
+class Framer
+{
+public:
+    Framer(const entwine::Schema& schema, Executor& executor);
+
+    // Frames that no worker has started are abandoned.
+    ~Framer();
+
+    // Takes ownership of the data, leaving an empty buffer in its place.
+    // Must not be called while full().
+    void push(Data& data);
+
+    // Swap the next frame into data, in push order.  If wait is false and
+    // that frame is not yet complete, returns false immediately.  Returns
+    // false if there are no outstanding frames.  Compression errors are
+    // rethrown here.
+    bool next(Data& data, bool wait);
+
+    bool full() const;
+    bool empty() const;
+
+private:
+    // Our tasks may outlive us, so they refer only to shared state.
+    struct Shared
+    {
+        Shared(const pdal::DimTypeList& dimTypes, std::size_t pointSize)
+            : dimTypes(dimTypes)
+            , pointSize(pointSize)
+            , canceled(false)
+        { }
+
+        const pdal::DimTypeList dimTypes;
+        const std::size_t pointSize;
+        std::atomic_bool canceled;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+    };
+
+    struct Slot
+    {
+        explicit Slot(Data& input) : claimed(false) { in.swap(input); }
+
+        Data in;
+        Data data;
+        std::exception_ptr error;
+        std::atomic_bool claimed;
+        bool done = false;
+    };
+
+    using SharedSlot = std::shared_ptr<Slot>;
+
+    static void run(Shared& shared, Slot& slot);
+
+    Executor& m_executor;
+    const std::shared_ptr<Shared> m_shared;
+    const std::size_t m_capacity;
+
+    std::deque<SharedSlot> m_slots;
+};
+
+} // namespace greyhound
+
@@ -0,0 +1,76 @@
+#include <greyhound/hierarchy.hpp>
+
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+namespace greyhound
+{
+
+namespace hierarchy
+{
+
+namespace
+{
+    const uint64_t countMask((uint64_t(1) << 56) - 1);
+
+    template<typename T>
+    void put(Data& data, std::size_t offset, T v)
+    {
+        std::memcpy(data.data() + offset, &v, sizeof(T));
+    }
+}
+
+Data toBinary(const Json::Value& json)
+{
+    const std::size_t headerSize(sizeof(uint32_t) * 2);
+
+    Data data(headerSize);
+    put<uint32_t>(data, 0, binaryVersion);
+
+    std::deque<const Json::Value*> queue;
+    if (json.isObject() && json.isMember("n")) queue.push_back(&json);
+
+    uint32_t numNodes(0);
+
+    while (!queue.empty())
+    {
+        const Json::Value& node(*queue.front());
+        queue.pop_front();
+
+        uint64_t mask(0);
+        for (std::size_t i(0); i < 8; ++i)
+        {
+            // Quadtree keys omit the vertical direction.
+            const Json::Value* child(node.find(dirs[i], dirs[i] + 3));
+            if (!child && i < 4) child = node.find(dirs[i], dirs[i] + 2);
+
+            if (child && child->isObject())
+            {
+                mask |= uint64_t(1) << i;
+                queue.push_back(child);
+            }
+        }
+
+        const uint64_t n(node["n"].asUInt64());
+        if (n > countMask)
+        {
+            throw std::runtime_error("Hierarchy count is too large");
+        }
+
+        data.resize(data.size() + sizeof(uint64_t));
+        put<uint64_t>(
+                data,
+                data.size() - sizeof(uint64_t),
+                n | (mask << 56));
+        ++numNodes;
+    }
+
+    put<uint32_t>(data, sizeof(uint32_t), numNodes);
+    return data;
+}
+
+} // namespace hierarchy
+
+} // namespace greyhound
+
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include <json/json.h>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+namespace hierarchy
+{
+    // Octree children of a hierarchy node, in the order of their bits in a
+    // child mask: bit 0 is east, bit 1 is north, and bit 2 is up.  Quadtree
+    // children are the first four, without their last character.
+    const char* const dirs[] = {
+        "swd", "sed", "nwd", "ned", "swu", "seu", "nwu", "neu"
+    };
+
+    const uint32_t binaryVersion(1);
+
+    // Flattens a JSON hierarchy into a compact binary form, laid out as:
+    //
+    //      uint32_t version        Currently 1.
+    //      uint32_t numNodes       Number of nodes that follow.
+    //      uint64_t[numNodes]      Nodes in breadth-first order.
+    //
+    // All integers are little-endian.  The low 56 bits of each node are its
+    // point count, and the high 8 bits are the mask of its children present
+    // in the following depth.  Since the children of each node follow those
+    // of its predecessors at that depth, the tree may be traversed in place.
+    // An empty hierarchy has no nodes.
+    Data toBinary(const Json::Value& json);
+}
+
+} // namespace greyhound
+
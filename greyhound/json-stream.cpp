@@ -0,0 +1,131 @@
+#include <greyhound/json-stream.hpp>
+
+namespace greyhound
+{
+
+JsonStream::JsonStream(Sink sink, const std::size_t flushBytes)
+    : m_sink(sink)
+    , m_flushBytes(flushBytes)
+{
+    m_buffer.reserve(m_flushBytes);
+}
+
+void JsonStream::beginObject() { open('{'); }
+void JsonStream::endObject() { close('}'); }
+void JsonStream::beginArray() { open('['); }
+void JsonStream::endArray() { close(']'); }
+
+void JsonStream::key(const std::string& name)
+{
+    separate();
+    put(Json::valueToQuotedString(name.c_str()));
+    put(':');
+    m_keyed = true;
+}
+
+void JsonStream::value(const std::string& s)
+{
+    separate();
+    put(Json::valueToQuotedString(s.c_str()));
+}
+
+void JsonStream::value(const uint64_t v)
+{
+    separate();
+    put(Json::valueToString(Json::LargestUInt(v)));
+}
+
+void JsonStream::value(const Json::Value& json)
+{
+    if (m_canceled) return;
+
+    switch (json.type())
+    {
+        case Json::objectValue:
+            beginObject();
+            for (auto it(json.begin()); it != json.end(); ++it)
+            {
+                key(it.name());
+                value(*it);
+            }
+            endObject();
+            break;
+
+        case Json::arrayValue:
+            beginArray();
+            for (const Json::Value& v : json) value(v);
+            endArray();
+            break;
+
+        case Json::intValue:
+            separate();
+            put(Json::valueToString(json.asLargestInt()));
+            break;
+
+        case Json::uintValue:
+            separate();
+            put(Json::valueToString(json.asLargestUInt()));
+            break;
+
+        case Json::realValue:
+            separate();
+            put(Json::valueToString(json.asDouble()));
+            break;
+
+        case Json::stringValue:
+            separate();
+            put(Json::valueToQuotedString(json.asCString()));
+            break;
+
+        case Json::booleanValue:
+            separate();
+            put(json.asBool() ? "true" : "false");
+            break;
+
+        default:
+            separate();
+            put("null");
+            break;
+    }
+}
+
+void JsonStream::done()
+{
+    flush();
+}
+
+void JsonStream::separate()
+{
+    if (m_keyed) m_keyed = false;
+    else if (!m_empty.empty())
+    {
+        if (!m_empty.back()) put(',');
+        m_empty.back() = false;
+    }
+}
+
+void JsonStream::open(const char c)
+{
+    separate();
+    put(c);
+    m_empty.push_back(true);
+}
+
+void JsonStream::close(const char c)
+{
+    m_empty.pop_back();
+    put(c);
+    if (m_buffer.size() >= m_flushBytes) flush();
+}
+
+void JsonStream::flush()
+{
+    if (!m_canceled && !m_buffer.empty())
+    {
+        m_canceled = !m_sink(m_buffer.data(), m_buffer.size());
+    }
+    m_buffer.clear();
+}
+
+} // namespace greyhound
+
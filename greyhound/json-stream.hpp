@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+namespace greyhound
+{
+
+// Serializes JSON incrementally, in the same format as dense(), so that large
+// responses need not be built in full as a Json::Value or as a string.
+// Output is buffered and handed to the sink in pieces of about flushBytes.
+// If the sink returns false, for example because the client has gone away,
+// all further output is discarded and canceled() becomes true, so producers
+// may stop early.
+class JsonStream
+{
+public:
+    using Sink = std::function<bool(const char* pos, std::size_t size)>;
+
+    explicit JsonStream(Sink sink, std::size_t flushBytes = 1 << 16);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    // Within an object, each value must be preceded by its key.
+    void key(const std::string& name);
+
+    void value(const std::string& s);
+    void value(uint64_t v);
+    void value(const Json::Value& json);
+
+    // Hand any buffered output to the sink.
+    void done();
+
+    bool canceled() const { return m_canceled; }
+
+private:
+    // Writes the separator that precedes a value, if any.
+    void separate();
+    void open(char c);
+    void close(char c);
+    void flush();
+
+    void put(char c) { m_buffer.push_back(c); }
+    void put(const std::string& s)
+    {
+        m_buffer += s;
+        if (m_buffer.size() >= m_flushBytes) flush();
+    }
+
+    Sink m_sink;
+    const std::size_t m_flushBytes;
+    std::string m_buffer;
+    bool m_canceled = false;
+
+    // For each open object or array, whether it is still empty.
+    std::vector<bool> m_empty;
+    bool m_keyed = false;
+};
+
+} // namespace greyhound
+
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+#include <json/json.h>
+
+#include <entwine/util/json.hpp>
+
+namespace greyhound
+{
+
+// Serialize without whitespace, as for our JSON responses.
+inline std::string dense(const Json::Value& json)
+{
+    auto s = Json::FastWriter().write(json);
+    s.pop_back();
+    return s;
+}
+
+// Each query parameter value is itself parsed as JSON.
+template<typename Req> Json::Value parseQuery(Req& req)
+{
+    Json::Value q;
+    for (const auto& p : req.parse_query_string())
+    {
+        q[p.first] = entwine::parse(p.second);
+    }
+    return q;
+}
+
+} // namespace greyhound
+
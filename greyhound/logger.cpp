@@ -0,0 +1,427 @@
+#include <greyhound/logger.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+
+namespace greyhound
+{
+
+namespace
+{
+    // Interval between drains of the rings.
+    const std::chrono::milliseconds drainInterval(50);
+
+    // Loggers are identified by a serial number rather than their address,
+    // which may be reused by a later logger.
+    std::atomic_size_t nextId(1);
+
+    thread_local std::size_t localOwner(0);
+    thread_local void* localRing(nullptr);
+
+    template<std::size_t N>
+    void copy(std::array<char, N>& dst, const std::string& src)
+    {
+        const std::size_t n(std::min(src.size(), N - 1));
+        std::memcpy(dst.data(), src.data(), n);
+        dst[n] = 0;
+    }
+
+    enum class Color
+    {
+        Black,
+        Red,
+        Green,
+        Yellow,
+        Blue,
+        Magenta,
+        Cyan,
+        White
+    };
+
+    const std::map<Color, std::string> colorCodes {
+        { Color::Black,     "\x1b[30m" },
+        { Color::Red,       "\x1b[31m" },
+        { Color::Green,     "\x1b[32m" },
+        { Color::Yellow,    "\x1b[33m" },
+        { Color::Blue,      "\x1b[34m" },
+        { Color::Magenta,   "\x1b[35m" },
+        { Color::Cyan,      "\x1b[36m" },
+        { Color::White,     "\x1b[37m" }
+    };
+
+    std::string color(const std::string& s, Color c)
+    {
+        return colorCodes.at(c) + s + "\x1b[0m";
+    }
+
+    // The abbreviated name and color of each route in the text format.
+    std::pair<std::string, Color> label(Route route)
+    {
+        switch (route)
+        {
+            case Route::Info:       return { "info", Color::Green };
+            case Route::Hierarchy:  return { "hier", Color::Yellow };
+            case Route::Files:      return { "file", Color::Green };
+            case Route::Read:       return { "read", Color::Cyan };
+            case Route::Count:      return { "count", Color::Cyan };
+            case Route::Write:      return { "write", Color::Yellow };
+        }
+        return { "", Color::White };
+    }
+
+    std::string throughput(std::size_t bytes, double seconds)
+    {
+        if (seconds <= 0) return "-";
+        return std::to_string(
+                static_cast<std::size_t>(bytes / seconds / 1024.0 / 1024.0)) +
+            " MB/s";
+    }
+}
+
+std::string toString(const Route route)
+{
+    switch (route)
+    {
+        case Route::Info:       return "info";
+        case Route::Hierarchy:  return "hierarchy";
+        case Route::Files:      return "files";
+        case Route::Read:       return "read";
+        case Route::Count:      return "count";
+        case Route::Write:      return "write";
+    }
+    return "";
+}
+
+AccessRecord::AccessRecord(
+        const Route route,
+        const std::string& name,
+        const TimePoint start)
+    : route(route)
+    , time(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count())
+    , ms(std::chrono::duration<double, std::milli>(getNow() - start).count())
+{
+    copy(resource, name);
+    compression[0] = 0;
+    filter[0] = 0;
+}
+
+void AccessRecord::setDepth(const Json::Value& q)
+{
+    if (q.isMember("depthBegin")) depthBegin = q["depthBegin"].asUInt();
+    else if (q.isMember("depth")) depthBegin = q["depth"].asUInt();
+
+    if (q.isMember("depthEnd")) depthEnd = q["depthEnd"].asUInt();
+    else if (q.isMember("depth")) depthEnd = q["depth"].asUInt() + 1;
+}
+
+void AccessRecord::setFilter(const std::string& s)
+{
+    copy(filter, s);
+}
+
+void AccessRecord::setCompression(const std::string& name, const bool f)
+{
+    copy(compression, name);
+    framed = f;
+}
+
+void AccessRecord::setTiming(const Timing& timing)
+{
+    for (std::size_t i(0); i < stages.size(); ++i)
+    {
+        stages[i] = timing.get(static_cast<Timing::Stage>(i));
+    }
+}
+
+Logger::Logger(const Json::Value& config)
+    : m_id(nextId++)
+    , m_format(config.isMember("format") ? config["format"].asString() : "text")
+    , m_path(config["path"].asString())
+    , m_sampleRate(
+            config.isMember("sampleRate") ?
+                std::max(std::min(config["sampleRate"].asDouble(), 1.0), 0.0) :
+                1.0)
+    , m_out(&std::cout)
+    , m_logged(0)
+    , m_dropped(0)
+    , m_skipped(0)
+{
+    if (m_format != "text" && m_format != "json")
+    {
+        throw std::runtime_error("Invalid log format: " + m_format);
+    }
+
+    if (m_path.size())
+    {
+        m_file.open(m_path, std::ofstream::out | std::ofstream::app);
+        if (!m_file.good())
+        {
+            throw std::runtime_error("Could not open log file: " + m_path);
+        }
+        m_out = &m_file;
+    }
+
+    m_thread = std::thread([this]() { run(); });
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_done = true;
+    }
+
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void Logger::log(const AccessRecord& record)
+{
+    if (!sample())
+    {
+        ++m_skipped;
+        return;
+    }
+
+    Ring& r(ring());
+    const std::size_t head(r.head.load(std::memory_order_relaxed));
+
+    if (head - r.tail.load(std::memory_order_acquire) >= capacity)
+    {
+        ++m_dropped;
+        return;
+    }
+
+    r.records[head % capacity] = record;
+    r.head.store(head + 1, std::memory_order_release);
+}
+
+Logger::Ring& Logger::ring()
+{
+    // Rings are registered once per thread, and are retained after their
+    // thread exits so that we may finish draining them.
+    if (localOwner != m_id)
+    {
+        auto ring(std::make_shared<Ring>());
+
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.push_back(ring);
+        localOwner = m_id;
+        localRing = ring.get();
+    }
+
+    return *static_cast<Ring*>(localRing);
+}
+
+bool Logger::sample()
+{
+    if (m_sampleRate >= 1) return true;
+
+    thread_local std::minstd_rand engine(
+            std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::uniform_real_distribution<double> distribution(0, 1);
+    return distribution(engine) < m_sampleRate;
+}
+
+void Logger::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    const auto done([this]() { return m_done; });
+
+    while (!m_cv.wait_for(lock, drainInterval, done))
+    {
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+
+    lock.unlock();
+    drain();
+}
+
+void Logger::drain()
+{
+    std::vector<std::shared_ptr<Ring>> rings;
+
+    {
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        rings = m_rings;
+    }
+
+    bool any(false);
+
+    for (auto& r : rings)
+    {
+        const std::size_t head(r->head.load(std::memory_order_acquire));
+        std::size_t tail(r->tail.load(std::memory_order_relaxed));
+
+        for ( ; tail != head; ++tail)
+        {
+            write(r->records[tail % capacity]);
+            ++m_logged;
+            any = true;
+        }
+
+        r->tail.store(tail, std::memory_order_release);
+    }
+
+    const std::size_t dropped(m_dropped);
+    if (dropped != m_reportedDrops)
+    {
+        std::ostringstream os;
+        os << "Access log overloaded - " << (dropped - m_reportedDrops) <<
+            " records dropped";
+
+        if (m_format == "json")
+        {
+            Json::Value json;
+            json["message"] = os.str();
+            json["dropped"] = static_cast<Json::UInt64>(dropped);
+            *m_out << Json::FastWriter().write(json);
+        }
+        else *m_out << os.str() << "\n";
+
+        m_reportedDrops = dropped;
+        any = true;
+    }
+
+    if (any) m_out->flush();
+}
+
+void Logger::write(const AccessRecord& r)
+{
+    std::ostream& out(*m_out);
+
+    const std::string name(r.resource.data());
+    const std::string codec(r.compression.data());
+    const std::string filter(r.filter.data());
+
+    if (m_format == "json")
+    {
+        Json::Value json;
+        json["time"] = static_cast<Json::Int64>(r.time);
+        json["resource"] = name;
+        json["route"] = toString(r.route);
+        json["ms"] = r.ms;
+
+        if (r.depthBegin >= 0 || r.depthEnd >= 0)
+        {
+            json["depthBegin"] = static_cast<Json::Int64>(r.depthBegin);
+            json["depthEnd"] = static_cast<Json::Int64>(r.depthEnd);
+        }
+
+        if (r.points) json["points"] = static_cast<Json::UInt64>(r.points);
+        if (r.bytes) json["bytes"] = static_cast<Json::UInt64>(r.bytes);
+        if (filter.size()) json["filter"] = filter;
+
+        if (codec.size())
+        {
+            json["compression"] = codec;
+            if (r.framed) json["framed"] = true;
+            json["rawBytes"] = static_cast<Json::UInt64>(r.rawBytes);
+            if (r.encodedBytes)
+            {
+                json["encodedBytes"] =
+                    static_cast<Json::UInt64>(r.encodedBytes);
+                json["encodeSeconds"] = r.encodeSeconds;
+            }
+        }
+
+        if (r.cached) json["cached"] = true;
+        if (r.canceled) json["canceled"] = true;
+
+        // Stage durations in milliseconds, for stages that took any time.
+        for (std::size_t i(0); i < r.stages.size(); ++i)
+        {
+            if (r.stages[i] > 0)
+            {
+                const auto stage(static_cast<Timing::Stage>(i));
+                json["stages"][toString(stage)] = r.stages[i] * 1000.0;
+            }
+        }
+
+        out << Json::FastWriter().write(json);
+        return;
+    }
+
+    // Only colorize output to a terminal.
+    const bool colored(!m_file.is_open());
+    auto paint([colored](const std::string& s, Color c)
+    {
+        return colored ? color(s, c) : s;
+    });
+
+    const auto l(label(r.route));
+
+    out << name << "/" << paint(l.first, l.second) << ": " <<
+        paint(std::to_string(static_cast<std::size_t>(r.ms)), Color::Magenta) <<
+        " ms";
+
+    if (r.cached)
+    {
+        out << " " << paint("cached", Color::Green) << "\n";
+        return;
+    }
+
+    if (r.route == Route::Files)
+    {
+        out << " Q: " << filter << "\n";
+        return;
+    }
+
+    if (r.route != Route::Info)
+    {
+        out << " D: [";
+        if (r.depthBegin >= 0) out << r.depthBegin;
+        else out << "all";
+
+        out << ", ";
+        if (r.depthEnd >= 0) out << r.depthEnd;
+        else out << "all";
+        out << ")";
+    }
+
+    if (r.route == Route::Read || r.route == Route::Count ||
+            r.route == Route::Write)
+    {
+        out << " P: " << r.points;
+        if (filter.size()) out << " F: " << filter;
+    }
+
+    if (codec.size())
+    {
+        out << " C: " << codec << (r.framed ? " framed " : " ");
+        if (!r.encodedBytes) out << r.rawBytes << " B";
+        else
+        {
+            out << r.rawBytes << "->" << r.encodedBytes << " B " <<
+                throughput(r.rawBytes, r.encodeSeconds);
+        }
+    }
+
+    bool timed(false);
+    for (std::size_t i(0); i < r.stages.size(); ++i)
+    {
+        if (r.stages[i] > 0)
+        {
+            out << (timed ? ", " : " T: ") <<
+                toString(static_cast<Timing::Stage>(i)) << " " <<
+                static_cast<std::size_t>(r.stages[i] * 1000.0) << " ms";
+            timed = true;
+        }
+    }
+
+    if (r.canceled) out << " " << paint("canceled", Color::Red);
+
+    out << "\n";
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <json/json.h>
+
+#include <greyhound/defs.hpp>
+#include <greyhound/timing.hpp>
+
+namespace greyhound
+{
+
+enum class Route : uint8_t
+{
+    Info,
+    Hierarchy,
+    Files,
+    Read,
+    Count,
+    Write
+};
+
+std::string toString(Route route);
+
+// A fixed-size description of a single handled request, so that logging it
+// requires no allocation.  String fields are truncated to fit.
+struct AccessRecord
+{
+    AccessRecord() = default;
+    AccessRecord(Route route, const std::string& resource, TimePoint start);
+
+    // Record the depth range of a query, of which either end may be absent.
+    void setDepth(const Json::Value& q);
+
+    // The filter of a query, or the search of a files query.
+    void setFilter(const std::string& s);
+
+    void setCompression(const std::string& name, bool framed);
+
+    void setTiming(const Timing& timing);
+
+    Route route = Route::Info;
+    int64_t time = 0;   // Milliseconds since the epoch.
+    double ms = 0;
+
+    int64_t depthBegin = -1;
+    int64_t depthEnd = -1;
+    uint64_t points = 0;
+
+    // Bytes of the response body.
+    uint64_t bytes = 0;
+
+    // Bytes of point data before and after compression.  Encoded bytes and
+    // encoding time are zero if the compression was not measured.
+    uint64_t rawBytes = 0;
+    uint64_t encodedBytes = 0;
+    double encodeSeconds = 0;
+
+    // Seconds spent in each stage of handling the request.
+    std::array<double, Timing::numStages> stages {{ }};
+
+    bool cached = false;
+    bool canceled = false;
+    bool framed = false;
+
+    std::array<char, 64> resource;
+    std::array<char, 16> compression;
+    std::array<char, 160> filter;
+};
+
+// Asynchronous access logging.  Each request thread pushes records into its
+// own single-producer ring buffer without locking, and a background thread
+// drains the rings, formats the records, and writes them out in batches.
+// Records are dropped rather than blocking if a ring is full, and may be
+// sampled to reduce load further.
+class Logger
+{
+public:
+    // Configured by the "log" section: "format" is "text" or "json", "path"
+    // is a file to append to rather than stdout, and "sampleRate" is the
+    // fraction of requests to log.
+    explicit Logger(const Json::Value& config);
+
+    // Writes out any remaining records.
+    ~Logger();
+
+    void log(const AccessRecord& record);
+
+    std::size_t logged() const { return m_logged; }
+    std::size_t dropped() const { return m_dropped; }
+    std::size_t skipped() const { return m_skipped; }
+
+    const std::string& format() const { return m_format; }
+    const std::string& path() const { return m_path; }
+    double sampleRate() const { return m_sampleRate; }
+
+private:
+    static const std::size_t capacity = 512;
+
+    struct Ring
+    {
+        Ring() : records(capacity), head(0), tail(0) { }
+
+        std::vector<AccessRecord> records;
+        std::atomic_size_t head;
+        std::atomic_size_t tail;
+    };
+
+    Ring& ring();
+    bool sample();
+
+    void run();
+    void drain();
+    void write(const AccessRecord& record);
+
+    const std::size_t m_id;
+    const std::string m_format;
+    const std::string m_path;
+    const double m_sampleRate;
+
+    std::ofstream m_file;
+    std::ostream* m_out;
+
+    std::vector<std::shared_ptr<Ring>> m_rings;
+    std::mutex m_ringsMutex;
+
+    std::atomic_size_t m_logged;
+    std::atomic_size_t m_dropped;
+    std::atomic_size_t m_skipped;
+    std::size_t m_reportedDrops = 0;
+
+    bool m_done = false;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+};
+
+} // namespace greyhound
+
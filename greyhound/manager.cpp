@@ -2,11 +2,19 @@
 
 #include <algorithm>
 #include <cctype>
+#include <fstream>
+#include <random>
+#include <set>
 #include <thread>
 
+#include <unistd.h>
+
 #include <entwine/reader/reader.hpp>
 #include <entwine/util/json.hpp>
 
+#include <greyhound/etag.hpp>
+#include <greyhound/json.hpp>
+
 namespace greyhound
 {
 
@@ -34,11 +42,18 @@ namespace
         return n * m;
     }
 
-    std::string dense(const Json::Value& json)
+    // Interval between sweeps.  Passes are cheap, and short intervals let us
+    // respond quickly to memory pressure.
+    const std::chrono::seconds sweepInterval(1);
+
+    // Returns zero if the resident set size cannot be determined.
+    std::size_t residentBytes()
     {
-        auto s = Json::FastWriter().write(json);
-        s.pop_back();
-        return s;
+        std::ifstream statm("/proc/self/statm");
+        std::size_t pages(0);
+        std::size_t resident(0);
+        if (!(statm >> pages >> resident)) return 0;
+        return resident * ::sysconf(_SC_PAGESIZE);
     }
 }
 
@@ -47,13 +62,31 @@ Manager::Manager(const Configuration& config)
             config["cacheSize"].isString() ?
                 parseBytes(config["cacheSize"].asString()) :
                 config["cacheSize"].asUInt64())
+    , m_readCache(
+            config["readCacheSize"].isString() ?
+                parseBytes(config["readCacheSize"].asString()) :
+                config["readCacheSize"].asUInt64())
+    , m_hierarchyCache(
+            config["hierarchyCacheSize"].isString() ?
+                parseBytes(config["hierarchyCacheSize"].asString()) :
+                config["hierarchyCacheSize"].asUInt64())
+    , m_missCache(config["missingTimeoutSeconds"].asUInt64())
     , m_paths(entwine::extract<std::string>(config["paths"]))
     , m_threads(std::max<std::size_t>(config["threads"].asUInt(), 4))
+    , m_logger(config["log"])
     , m_config(config)
-    , m_swept(getNow())
+    , m_idleSweeps(0)
+    , m_pressureSweeps(0)
+    , m_ready(false)
+    , m_merges(m_threads)
+    , m_executor(m_threads)
+    , m_requests(m_threads)
 {
     m_outerScope.getArbiter(config["arbiter"]);
-    m_auth = Auth::maybeCreate(config, *m_outerScope.getArbiter());
+    m_auth = Auth::maybeCreate(
+            config,
+            *m_outerScope.getArbiter(),
+            m_executor);
 
     for (const auto key : config["http"]["headers"].getMemberNames())
     {
@@ -67,12 +100,59 @@ Manager::Manager(const Configuration& config)
     m_timeoutSeconds = std::max<double>(
             60.0 * config["resourceTimeoutMinutes"].asDouble(), 15);
 
+    m_immutableMaxAge = config["http"]["immutableMaxAge"].asUInt64();
+    m_negotiateEncoding = config["http"]["negotiateEncoding"].asBool();
+
+    m_instance = etag::digest(
+            std::to_string(std::random_device()()) + "/" +
+            std::to_string(getNow().time_since_epoch().count()));
+
+    m_writeSizeLimit = config["writeSizeLimit"].isString() ?
+        parseBytes(config["writeSizeLimit"].asString()) :
+        config["writeSizeLimit"].asUInt64();
+
+    if (config.json().isMember("memoryLimit"))
+    {
+        m_memoryLimit = config["memoryLimit"].isString() ?
+            parseBytes(config["memoryLimit"].asString()) :
+            config["memoryLimit"].asUInt64();
+    }
+
     std::cout << "Settings:" << std::endl;
     std::cout << "\tCache: " << m_cache.maxBytes() << " bytes" << std::endl;
+    std::cout << "\tRead cache: " << m_readCache.maxBytes() << " bytes" <<
+        std::endl;
+    std::cout << "\tHierarchy cache: " << m_hierarchyCache.maxBytes() <<
+        " bytes" << std::endl;
     std::cout << "\tThreads: " << m_threads << std::endl;
+    if (m_immutableMaxAge)
+    {
+        std::cout << "\tImmutable max age: " << m_immutableMaxAge <<
+            " seconds" << std::endl;
+    }
     std::cout << "\tResource timeout: " <<
         (m_timeoutSeconds / 60.0)  << " minutes" << std::endl;
+    std::cout << "\tMissing resource timeout: " <<
+        m_missCache.timeoutSeconds() << " seconds" << std::endl;
+    if (m_memoryLimit)
+    {
+        std::cout << "\tMemory limit: " << m_memoryLimit << " bytes" <<
+            std::endl;
+
+        if (!residentBytes())
+        {
+            std::cout << "\t\tMemory usage is not measurable on this " <<
+                "platform - the limit will not be enforced" << std::endl;
+        }
+    }
     std::cout << "\tTmp dir: " << m_config["tmp"].asString() << std::endl;
+    std::cout << "\tAccess log: " << m_logger.format() << " to " <<
+        (m_logger.path().size() ? m_logger.path() : "stdout");
+    if (m_logger.sampleRate() < 1)
+    {
+        std::cout << ", sampled at " << m_logger.sampleRate();
+    }
+    std::cout << std::endl;
     std::cout << "Paths:" << std::endl;
     for (const auto p : m_paths) std::cout << "\t" << p << std::endl;
 
@@ -118,19 +198,377 @@ Manager::Manager(const Configuration& config)
             std::endl;
         std::cout << "\tFailure timeout: " << m_auth->badSeconds() << "s" <<
             std::endl;
+        std::cout << "\tCached users: " << m_auth->maxUsers() << std::endl;
+        if (m_auth->batch().size())
+        {
+            std::cout << "\tBatch path: " << m_auth->batch() << std::endl;
+        }
+    }
+
+    const Json::Value& prewarming(config["prewarm"]);
+    if (prewarming["resources"].size())
+    {
+        std::cout << "Prewarm:" << std::endl;
+        std::cout << "\tResources: " << dense(prewarming["resources"]) <<
+            std::endl;
+        std::cout << "\tDepth: [" << prewarming["depthBegin"].asUInt() <<
+            ", " << prewarming["depthEnd"].asUInt() << ")" << std::endl;
+    }
+
+    m_sweeper = std::thread([this]() { sweep(); });
+    m_prewarmer = std::thread([this]() { prewarm(); });
+}
+
+Manager::~Manager()
+{
+    m_prewarmer.join();
+
+    {
+        std::lock_guard<std::mutex> lock(m_sweepMutex);
+        m_done = true;
+    }
+
+    m_sweepCv.notify_all();
+    m_sweeper.join();
+}
+
+TimedReader& Manager::reader(const std::string& name)
+{
+    auto it(m_readers.find(name));
+    if (it == m_readers.end())
+    {
+        if (m_missCache.has(name))
+        {
+            throw HttpError(
+                    HttpStatusCode::client_error_not_found,
+                    "Not found: " + name);
+        }
+
+        it = m_readers.emplace(
+                std::piecewise_construct,
+                std::forward_as_tuple(name),
+                std::forward_as_tuple(*this, name)).first;
+    }
+
+    return it->second;
+}
+
+void Manager::prewarm()
+{
+    const Json::Value& config(m_config["prewarm"]);
+    const auto start(getNow());
+
+    Json::Value q;
+    q["depthBegin"] = config["depthBegin"].asUInt();
+    q["depthEnd"] = config["depthEnd"].asUInt();
+
+    std::set<std::string> names;
+    for (const std::string& name : entwine::extract<std::string>(
+                config["resources"]))
+    {
+        for (const auto& s : resolve(name)) names.insert(s);
+    }
+
+    TaskGroup group(m_executor);
+
+    for (const std::string& name : names)
+    {
+        group.add([this, name, &q]()
+        {
+            try
+            {
+                TimedReader* timed(nullptr);
+
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    timed = &reader(name);
+                }
+
+                // Creation loads the base data, and everything we fetch here
+                // is retained in the chunk cache.
+                SharedReader reader(timed->get());
+                reader->hierarchy(q);
+
+                if (q["depthEnd"].asUInt() > q["depthBegin"].asUInt())
+                {
+                    auto query(reader->getQuery(q));
+                    while (!query->done())
+                    {
+                        query->next();
+                        query->data().clear();
+                    }
+                }
+
+                std::cout << "Prewarmed " << name << std::endl;
+            }
+            catch (std::exception& e)
+            {
+                std::cout << "Prewarm error - " << name << ": " << e.what() <<
+                    std::endl;
+            }
+        });
+    }
+
+    group.wait();
+
+    if (names.size())
+    {
+        std::cout << "Prewarm complete: " << secondsSince(start) << "s" <<
+            std::endl;
     }
+
+    m_ready = true;
 }
 
 void Manager::sweep()
 {
-    if (secondsSince(m_swept) < m_timeoutSeconds) return;
+    std::unique_lock<std::mutex> lock(m_sweepMutex);
+    const auto done([this]() { return m_done; });
 
-    for (auto it(m_readers.begin()); it != m_readers.end(); ++it)
+    while (!m_sweepCv.wait_for(lock, sweepInterval, done))
     {
-        TimedReader& tr(it->second);
-        if (tr.sweep()) return;
+        lock.unlock();
+
+        try
+        {
+            sweepOnce();
+        }
+        catch (std::exception& e)
+        {
+            std::cout << "Sweep error: " << e.what() << std::endl;
+        }
+        catch (...)
+        {
+            std::cout << "Sweep error: unknown" << std::endl;
+        }
+
+        lock.lock();
     }
 }
 
+void Manager::sweepOnce()
+{
+    // Readers are never removed from our map, so these remain valid.
+    std::vector<TimedReader*> readers;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& p : m_readers) readers.push_back(&p.second);
+    }
+
+    std::vector<std::pair<TimePoint, TimedReader*>> lru;
+    for (TimedReader* r : readers) lru.emplace_back(r->touched(), r);
+    std::sort(
+            lru.begin(),
+            lru.end(),
+            [](const std::pair<TimePoint, TimedReader*>& a,
+               const std::pair<TimePoint, TimedReader*>& b)
+            {
+                return a.first < b.first;
+            });
+
+    for (auto& p : lru)
+    {
+        if (p.second->sweep()) ++m_idleSweeps;
+    }
+
+    if (!m_memoryLimit) return;
+
+    const std::size_t resident(residentBytes());
+    if (resident <= m_memoryLimit) return;
+
+    // Released memory is not necessarily returned to the system right away,
+    // so release a single reader per pass and measure again at the next one
+    // rather than releasing everything at once.
+    std::cout << "Resident memory " << resident << " exceeds limit " <<
+        m_memoryLimit << std::endl;
+
+    for (auto& p : lru)
+    {
+        if (p.second->sweep(true))
+        {
+            ++m_pressureSweeps;
+            return;
+        }
+    }
+}
+
+void Manager::writeMetrics(std::ostream& os) const
+{
+    m_metrics.write(os);
+
+    std::size_t readers(0);
+    std::size_t loaded(0);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        readers = m_readers.size();
+        for (const auto& p : m_readers)
+        {
+            if (p.second.loaded()) ++loaded;
+        }
+    }
+
+    metrics::write(
+            os,
+            "greyhound_readers",
+            "gauge",
+            "Resources that have been requested.",
+            readers);
+    metrics::write(
+            os,
+            "greyhound_readers_loaded",
+            "gauge",
+            "Resources whose readers are currently loaded.",
+            loaded);
+
+    const std::string sweeps("greyhound_reader_sweeps_total");
+    os << "# HELP " << sweeps << " Readers released by the sweeper.\n";
+    os << "# TYPE " << sweeps << " counter\n";
+    os << sweeps << "{reason=\"idle\"} " << m_idleSweeps << "\n";
+    os << sweeps << "{reason=\"memory\"} " << m_pressureSweeps << "\n";
+
+    metrics::write(
+            os,
+            "greyhound_request_threads",
+            "gauge",
+            "Worker threads that run request handlers.",
+            m_requests.threads());
+    metrics::write(
+            os,
+            "greyhound_request_queued",
+            "gauge",
+            "Requests waiting for a worker thread.",
+            m_requests.queued());
+
+    metrics::write(
+            os,
+            "greyhound_executor_threads",
+            "gauge",
+            "Worker threads of the shared executor.",
+            m_executor.threads());
+    metrics::write(
+            os,
+            "greyhound_executor_queued_tasks",
+            "gauge",
+            "Tasks waiting for a worker of the shared executor.",
+            m_executor.queued());
+
+    metrics::write(
+            os,
+            "greyhound_chunk_cache_max_bytes",
+            "gauge",
+            "Configured size of the data chunk cache.",
+            m_cache.maxBytes());
+    metrics::write(
+            os,
+            "greyhound_resident_memory_bytes",
+            "gauge",
+            "Resident memory of the process, if measurable.",
+            residentBytes());
+    metrics::write(
+            os,
+            "greyhound_memory_limit_bytes",
+            "gauge",
+            "Configured memory limit, or zero if unlimited.",
+            m_memoryLimit);
+
+    metrics::write(
+            os,
+            "greyhound_read_cache_bytes",
+            "gauge",
+            "Bytes of responses held by the read cache.",
+            m_readCache.bytes());
+    metrics::write(
+            os,
+            "greyhound_read_cache_max_bytes",
+            "gauge",
+            "Configured size of the read cache.",
+            m_readCache.maxBytes());
+    metrics::write(
+            os,
+            "greyhound_read_cache_hits_total",
+            "counter",
+            "Read requests found in the read cache.",
+            m_readCache.hits());
+    metrics::write(
+            os,
+            "greyhound_read_cache_misses_total",
+            "counter",
+            "Read requests not found in the read cache.",
+            m_readCache.misses());
+
+    metrics::write(
+            os,
+            "greyhound_hierarchy_cache_bytes",
+            "gauge",
+            "Bytes of responses held by the hierarchy cache.",
+            m_hierarchyCache.bytes());
+    metrics::write(
+            os,
+            "greyhound_hierarchy_cache_max_bytes",
+            "gauge",
+            "Configured size of the hierarchy cache.",
+            m_hierarchyCache.maxBytes());
+    metrics::write(
+            os,
+            "greyhound_hierarchy_cache_hits_total",
+            "counter",
+            "Hierarchy requests found in the hierarchy cache.",
+            m_hierarchyCache.hits());
+    metrics::write(
+            os,
+            "greyhound_hierarchy_cache_misses_total",
+            "counter",
+            "Hierarchy requests not found in the hierarchy cache.",
+            m_hierarchyCache.misses());
+
+    if (m_auth)
+    {
+        const Auth::Stats stats(m_auth->stats());
+
+        const std::string lookups("greyhound_auth_lookups_total");
+        os << "# HELP " << lookups << " Authorization cache lookups.\n";
+        os << "# TYPE " << lookups << " counter\n";
+        os << lookups << "{result=\"hit\"} " << stats.hits << "\n";
+        os << lookups << "{result=\"refreshing\"} " << stats.refreshing <<
+            "\n";
+        os << lookups << "{result=\"miss\"} " << stats.misses << "\n";
+
+        metrics::write(
+                os,
+                "greyhound_auth_fetches_total",
+                "counter",
+                "Requests made to the auth server.",
+                stats.fetches);
+        metrics::write(
+                os,
+                "greyhound_auth_failures_total",
+                "counter",
+                "Requests to the auth server which failed outright.",
+                stats.failures);
+        metrics::write(
+                os,
+                "greyhound_auth_fetch_seconds_total",
+                "counter",
+                "Total latency of requests to the auth server.",
+                stats.fetchSeconds);
+    }
+
+    metrics::write(
+            os,
+            "greyhound_access_log_dropped_total",
+            "counter",
+            "Access log records dropped because the log could not keep up.",
+            m_logger.dropped());
+
+    metrics::write(
+            os,
+            "greyhound_ready",
+            "gauge",
+            "Whether prewarming has completed.",
+            m_ready ? 1 : 0);
+}
+
 } // namespace greyhound
 
@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <map>
 #include <mutex>
+#include <ostream>
 #include <string>
+#include <thread>
 
 #include <entwine/reader/cache.hpp>
 #include <entwine/types/outer-scope.hpp>
@@ -11,7 +15,13 @@
 #include <greyhound/auth.hpp>
 #include <greyhound/configuration.hpp>
 #include <greyhound/defs.hpp>
+#include <greyhound/executor.hpp>
+#include <greyhound/logger.hpp>
+#include <greyhound/metrics.hpp>
+#include <greyhound/miss-cache.hpp>
+#include <greyhound/read-cache.hpp>
 #include <greyhound/resource.hpp>
+#include <greyhound/timing.hpp>
 
 namespace greyhound
 {
@@ -20,21 +30,84 @@ class Manager
 {
 public:
     Manager(const Configuration& config);
+    ~Manager();
 
+    // Time spent authorizing the request and creating its readers is added to
+    // the timing.
     template<typename Req>
-    SharedResource get(std::string name, Req& req);
+    SharedResource get(std::string name, Req& req, Timing& timing);
 
     entwine::Cache& cache() const { return m_cache; }
     entwine::OuterScope& outerScope() const { return m_outerScope; }
+    ReadCache& readCache() const { return m_readCache; }
+    ReadCache& hierarchyCache() const { return m_hierarchyCache; }
+    // Runs request handlers, which may block for as long as their clients
+    // take to receive a response.
+    Executor& requests() const { return m_requests; }
+
+    // Runs short subtasks, such as the fan-out of a request across readers,
+    // path probes, and background refreshes.  Tasks posted here must not
+    // block on a client, so that requests waiting on them always progress.
+    Executor& executor() const { return m_executor; }
+
+    // Runs the member queries of merged reads, which block until the request
+    // that started them consumes their output.
+    Executor& merges() const { return m_merges; }
+    MissCache& missCache() const { return m_missCache; }
+    Logger& logger() const { return m_logger; }
     const Paths& paths() const { return m_paths; }
     const Headers& headers() const { return m_headers; }
     std::size_t threads() const { return m_threads; }
     std::size_t timeoutSeconds() const { return m_timeoutSeconds; }
+    std::size_t memoryLimit() const { return m_memoryLimit; }
+
+    // The largest decoded /write payload we accept.
+    std::size_t writeSizeLimit() const { return m_writeSizeLimit; }
+
+    // The max-age of immutable responses, or zero if they are not marked as
+    // immutable.
+    std::size_t immutableMaxAge() const { return m_immutableMaxAge; }
+
+    // Whether reads without a compress parameter may be compressed according
+    // to their Accept-Encoding header.
+    bool negotiateEncoding() const { return m_negotiateEncoding; }
+
+    // Unique to this process, for versions that do not survive a restart.
+    const std::string& instance() const { return m_instance; }
 
     const Configuration& config() const { return m_config; }
-    void sweep();
+
+    // Record a handled request in our metrics and the access log.
+    void report(const AccessRecord& record) const
+    {
+        m_metrics.record(record);
+        m_logger.log(record);
+    }
+
+    // Record a request that failed with an error response.
+    void reportError(HttpStatusCode code) const { m_metrics.error(code); }
+
+    // Write our metrics in the Prometheus text format.
+    void writeMetrics(std::ostream& os) const;
+
+    // False until the resources configured for prewarming have been loaded.
+    bool ready() const { return m_ready; }
 
 private:
+    // Caller must hold m_mutex.
+    TimedReader& reader(const std::string& name);
+
+    // Runs on its own thread at startup.  Creates the configured readers
+    // concurrently, and loads their hierarchy and data over the configured
+    // depth range so that their first requests find it cached.
+    void prewarm();
+
+    // Runs on our sweeper thread, off of the request path.  Each pass
+    // releases readers that have exceeded the resource timeout, and while
+    // above the memory limit, releases the least recently used reader.
+    void sweep();
+    void sweepOnce();
+
     std::vector<std::string> resolve(std::string name) const
     {
         if (m_aliases.count(name)) return m_aliases.at(name);
@@ -43,10 +116,15 @@ private:
 
     mutable entwine::Cache m_cache;
     mutable entwine::OuterScope m_outerScope;
+    mutable ReadCache m_readCache;
+    mutable ReadCache m_hierarchyCache;
+    mutable MissCache m_missCache;
 
     Paths m_paths;
     Headers m_headers;
     const std::size_t m_threads;
+    mutable Logger m_logger;
+    mutable Metrics m_metrics;
 
     const Configuration& m_config;
     std::map<std::string, std::vector<std::string>> m_aliases;
@@ -57,12 +135,35 @@ private:
 
     mutable std::mutex m_mutex;
 
-    TimePoint m_swept;
     std::size_t m_timeoutSeconds = 0;
+    std::size_t m_memoryLimit = 0;
+    std::size_t m_writeSizeLimit = 0;
+    std::size_t m_immutableMaxAge = 0;
+    bool m_negotiateEncoding = false;
+    std::string m_instance;
+
+    // Readers released for idleness and for memory pressure.
+    std::atomic_size_t m_idleSweeps;
+    std::atomic_size_t m_pressureSweeps;
+
+    bool m_done = false;
+    std::mutex m_sweepMutex;
+    std::condition_variable m_sweepCv;
+    std::thread m_sweeper;
+
+    std::atomic_bool m_ready;
+    std::thread m_prewarmer;
+
+    // Declared last so that they are destroyed first: tasks still queued at
+    // shutdown may use any of the members above, and requests may wait on
+    // tasks of the other executors.
+    mutable Executor m_merges;
+    mutable Executor m_executor;
+    mutable Executor m_requests;
 };
 
 template<typename Req>
-SharedResource Manager::get(std::string name, Req& req)
+SharedResource Manager::get(std::string name, Req& req, Timing& timing)
 {
     std::unique_lock<std::mutex> lock(m_mutex);
 
@@ -71,19 +172,7 @@ SharedResource Manager::get(std::string name, Req& req)
     {
         std::vector<TimedReader*> readers;
 
-        for (const auto s : resolve(name))
-        {
-            auto rit(m_readers.find(s));
-            if (rit == m_readers.end())
-            {
-                rit = m_readers.emplace(
-                        std::piecewise_construct,
-                        std::forward_as_tuple(s),
-                        std::forward_as_tuple(*this, s)).first;
-            }
-
-            readers.push_back(&rit->second);
-        }
+        for (const auto& s : resolve(name)) readers.push_back(&reader(s));
 
         it = m_resources.emplace(
                 name,
@@ -94,32 +183,48 @@ SharedResource Manager::get(std::string name, Req& req)
 
     lock.unlock();
 
-    entwine::Pool pool(threads());
-
-    for (TimedReader* reader : resource->readers())
+    if (m_auth)
     {
-        const auto name(reader->name());
-        if (m_auth)
+        Timing::Scope scope(timing, Timing::Stage::Auth);
+
+        std::vector<std::string> names;
+        for (TimedReader* reader : resource->readers())
         {
-            const auto code(m_auth->check(name, req));
-            if (!ok(code))
-            {
-                throw HttpError(code, "Authorization failure: " + name);
-            }
+            names.push_back(reader->name());
         }
 
-        pool.add([reader, name]()
+        const auto codes(m_auth->check(names, req));
+        for (std::size_t i(0); i < names.size(); ++i)
         {
-            if (!reader->get())
+            if (!ok(codes[i]))
             {
-                throw HttpError(
-                        HttpStatusCode::client_error_not_found,
-                        "Not found: " + name);
+                throw HttpError(codes[i], "Authorization failure: " + names[i]);
             }
-        });
+        }
     }
 
-    pool.join();
+    // Readers that are already loaded need no work beyond a touch, and a lone
+    // reader that must be created is created inline, so only concurrent
+    // creation of multiple readers is dispatched to the executor.
+    Timing::Scope scope(timing, Timing::Stage::Create);
+    std::vector<TimedReader*> unloaded;
+
+    for (TimedReader* reader : resource->readers())
+    {
+        if (reader->loaded()) reader->get();
+        else unloaded.push_back(reader);
+    }
+
+    if (unloaded.size() == 1) unloaded.front()->get();
+    else if (unloaded.size() > 1)
+    {
+        TaskGroup group(m_executor);
+        for (TimedReader* reader : unloaded)
+        {
+            group.add([reader]() { reader->get(); });
+        }
+        group.wait();
+    }
 
     return resource;
 }
@@ -0,0 +1,192 @@
+#include <greyhound/merger.hpp>
+
+#include <algorithm>
+
+#include <entwine/reader/reader.hpp>
+
+namespace greyhound
+{
+
+namespace
+{
+    // Maximum number of buffers held for a single reader before its query
+    // blocks waiting for the consumer.
+    const std::size_t maxQueued(4);
+}
+
+Merger::Mode Merger::mode(const Json::Value& q)
+{
+    const std::string s(q["merge"].asString());
+    if (s.empty() || s == "ordered") return Mode::Ordered;
+    else if (s == "interleaved") return Mode::Interleaved;
+    else throw Http400("Invalid merge mode: " + s);
+}
+
+Merger::Merger(
+        const std::vector<TimedReader*>& readers,
+        const Json::Value& q,
+        const Mode mode,
+        Executor& executor)
+    : m_readers(readers)
+    , m_query(q)
+    , m_mode(mode)
+    , m_slots(readers.size())
+    , m_claimed(0)
+    , m_canceled(false)
+    , m_tasks(executor)
+{
+    // Each task claims readers in order until none remain.  Because readers
+    // are claimed in order, an ordered consumer never waits on an unclaimed
+    // reader while every task is blocked on a later one.
+    const std::size_t tasks(
+            std::max<std::size_t>(
+                std::min(executor.threads(), readers.size()),
+                1));
+    for (std::size_t i(0); i < tasks; ++i) m_tasks.add([this]() { work(); });
+}
+
+Merger::~Merger()
+{
+    // Once canceled, our tasks return promptly, and any that have not started
+    // run to nothing while our task group waits for them.
+    cancel();
+}
+
+void Merger::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_canceled = true;
+    }
+    m_cv.notify_all();
+}
+
+void Merger::work()
+{
+    while (!m_canceled)
+    {
+        const std::size_t i(m_claimed++);
+        if (i >= m_slots.size()) return;
+
+        Slot& slot(m_slots[i]);
+        uint32_t points(0);
+        std::exception_ptr error;
+
+        try
+        {
+            SharedReader reader(m_readers[i]->get());
+            auto query(reader->getQuery(m_query));
+
+            while (!query->done() && !m_canceled)
+            {
+                query->next();
+
+                Data data;
+                data.swap(query->data());
+                if (!data.empty() && !push(slot, data)) break;
+            }
+
+            points = query->numPoints();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            slot.points = points;
+            slot.error = error;
+            slot.done = true;
+        }
+        m_cv.notify_all();
+    }
+}
+
+bool Merger::push(Slot& slot, Data& data)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this, &slot]()
+    {
+        return m_canceled || slot.data.size() < maxQueued;
+    });
+
+    if (m_canceled) return false;
+
+    slot.data.emplace_back();
+    slot.data.back().swap(data);
+    lock.unlock();
+
+    m_cv.notify_all();
+    return true;
+}
+
+bool Merger::pop(Slot& slot, Data& data)
+{
+    if (slot.data.empty()) return false;
+    data.swap(slot.data.front());
+    slot.data.pop_front();
+    return true;
+}
+
+bool Merger::next(Data& data)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        if (m_canceled) return false;
+
+        if (m_mode == Mode::Ordered)
+        {
+            while (m_current < m_slots.size())
+            {
+                Slot& slot(m_slots[m_current]);
+                if (slot.error) std::rethrow_exception(slot.error);
+                if (slot.done && slot.data.empty()) ++m_current;
+                else break;
+            }
+
+            if (m_current == m_slots.size()) return false;
+
+            if (pop(m_slots[m_current], data))
+            {
+                lock.unlock();
+                m_cv.notify_all();
+                return true;
+            }
+        }
+        else
+        {
+            bool complete(true);
+
+            for (Slot& slot : m_slots)
+            {
+                if (slot.error) std::rethrow_exception(slot.error);
+
+                if (pop(slot, data))
+                {
+                    lock.unlock();
+                    m_cv.notify_all();
+                    return true;
+                }
+
+                if (!slot.done) complete = false;
+            }
+
+            if (complete) return false;
+        }
+
+        m_cv.wait(lock);
+    }
+}
+
+uint32_t Merger::points() const
+{
+    uint32_t points(0);
+    for (const Slot& slot : m_slots) points += slot.points;
+    return points;
+}
+
+} // namespace greyhound
+
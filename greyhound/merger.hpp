@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <vector>
+
+#include <json/json.h>
+
+#include <greyhound/defs.hpp>
+#include <greyhound/executor.hpp>
+#include <greyhound/resource.hpp>
+
+namespace greyhound
+{
+
+// Runs a read query against each reader of a multi-resource concurrently on a
+// bounded number of threads, and merges their output into a single stream of
+// buffers for the calling thread.
+//
+// The queries block whenever the consumer falls behind, for as long as the
+// client takes to drain the response, so they must run on an executor
+// reserved for such work rather than the one for short subtasks.  Since they
+// block only on their own consumers, which run elsewhere, that executor always
+// makes progress.
+class Merger
+{
+public:
+    enum class Mode
+    {
+        // Output matches a sequential traversal of the readers.  Readers ahead
+        // of the current one buffer a bounded amount of data.
+        Ordered,
+
+        // Output is emitted in whatever order it becomes available.
+        Interleaved
+    };
+
+    static Mode mode(const Json::Value& q);
+
+    Merger(
+            const std::vector<TimedReader*>& readers,
+            const Json::Value& q,
+            Mode mode,
+            Executor& executor);
+
+    ~Merger();
+
+    // Blocks until a buffer of point data is available and swaps it into
+    // data.  Returns false once every query has completed.  Errors from any
+    // query are rethrown here.
+    bool next(Data& data);
+
+    // Stop all queries as soon as possible, for example after the client has
+    // disconnected.
+    void cancel();
+
+    // Only valid after next() has returned false.
+    uint32_t points() const;
+
+private:
+    struct Slot
+    {
+        std::deque<Data> data;
+        std::exception_ptr error;
+        uint32_t points = 0;
+        bool done = false;
+    };
+
+    void work();
+    bool push(Slot& slot, Data& data);
+    bool pop(Slot& slot, Data& data);
+
+    const std::vector<TimedReader*> m_readers;
+    const Json::Value m_query;
+    const Mode m_mode;
+
+    std::vector<Slot> m_slots;
+    std::size_t m_current = 0;
+    std::atomic_size_t m_claimed;
+    std::atomic_bool m_canceled;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+
+    // Declared last, so that our tasks are finished before the state they
+    // use is destroyed.
+    TaskGroup m_tasks;
+};
+
+} // namespace greyhound
+
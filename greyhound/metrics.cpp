@@ -0,0 +1,204 @@
+#include <greyhound/metrics.hpp>
+
+#include <sstream>
+
+namespace greyhound
+{
+
+namespace
+{
+    std::string number(const double v)
+    {
+        std::ostringstream os;
+        os.precision(12);
+        os << v;
+        return os.str();
+    }
+
+    void header(
+            std::ostream& os,
+            const std::string& name,
+            const std::string& type,
+            const std::string& help)
+    {
+        os << "# HELP " << name << " " << help << "\n";
+        os << "# TYPE " << name << " " << type << "\n";
+    }
+}
+
+const std::array<double, Histogram::numBuckets> Histogram::bounds {
+    {
+        0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1,
+        0.25, 0.5, 1, 2.5, 5, 10, 30
+    }
+};
+
+Histogram::Histogram()
+    : m_micros(0)
+{
+    for (auto& c : m_counts) c = 0;
+}
+
+void Histogram::observe(const double seconds)
+{
+    std::size_t i(0);
+    while (i < bounds.size() && seconds > bounds[i]) ++i;
+
+    m_counts[i].fetch_add(1, std::memory_order_relaxed);
+    m_micros.fetch_add(seconds * 1000000.0, std::memory_order_relaxed);
+}
+
+void Histogram::write(
+        std::ostream& os,
+        const std::string& name,
+        const std::string& labels) const
+{
+    const std::string prefix(labels.size() ? labels + "," : "");
+
+    uint64_t total(0);
+    for (std::size_t i(0); i < m_counts.size(); ++i)
+    {
+        total += m_counts[i].load(std::memory_order_relaxed);
+        const std::string le(i < bounds.size() ? number(bounds[i]) : "+Inf");
+        os << name << "_bucket{" << prefix << "le=\"" << le << "\"} " <<
+            total << "\n";
+    }
+
+    const std::string set(labels.size() ? "{" + labels + "}" : "");
+    os << name << "_sum" << set << " " <<
+        number(m_micros.load(std::memory_order_relaxed) / 1000000.0) << "\n";
+    os << name << "_count" << set << " " << total << "\n";
+}
+
+Metrics::Metrics()
+    : m_readBytes(0)
+    , m_readPoints(0)
+    , m_readsCached(0)
+    , m_readsCanceled(0)
+    , m_writePoints(0)
+    , m_clientErrors(0)
+    , m_serverErrors(0)
+    , m_rawBytes(0)
+    , m_encodedBytes(0)
+{ }
+
+void Metrics::record(const AccessRecord& r)
+{
+    m_latency[static_cast<std::size_t>(r.route)].observe(r.ms / 1000.0);
+
+    if (r.route == Route::Read)
+    {
+        m_readBytes += r.bytes;
+        m_readPoints += r.points;
+        if (r.cached) ++m_readsCached;
+        if (r.canceled) ++m_readsCanceled;
+    }
+    else if (r.route == Route::Write)
+    {
+        m_writePoints += r.points;
+    }
+
+    if (r.encodedBytes)
+    {
+        m_rawBytes += r.rawBytes;
+        m_encodedBytes += r.encodedBytes;
+    }
+}
+
+void Metrics::error(const HttpStatusCode code)
+{
+    if (static_cast<int>(code) >= 500) ++m_serverErrors;
+    else ++m_clientErrors;
+}
+
+void Metrics::write(std::ostream& os) const
+{
+    const std::string latency("greyhound_request_duration_seconds");
+    header(os, latency, "histogram", "Duration of successful requests.");
+
+    for (std::size_t i(0); i < m_latency.size(); ++i)
+    {
+        const Route route(static_cast<Route>(i));
+        m_latency[i].write(
+                os,
+                latency,
+                "route=\"" + toString(route) + "\"");
+    }
+
+    const std::string errors("greyhound_request_errors_total");
+    header(os, errors, "counter", "Requests that failed, by status class.");
+    os << errors << "{class=\"4xx\"} " << m_clientErrors << "\n";
+    os << errors << "{class=\"5xx\"} " << m_serverErrors << "\n";
+
+    metrics::write(
+            os,
+            "greyhound_read_bytes_total",
+            "counter",
+            "Response bytes sent by read requests.",
+            m_readBytes);
+    metrics::write(
+            os,
+            "greyhound_read_points_total",
+            "counter",
+            "Points sent by read requests.",
+            m_readPoints);
+    metrics::write(
+            os,
+            "greyhound_read_cached_total",
+            "counter",
+            "Read requests served from the read cache.",
+            m_readsCached);
+    metrics::write(
+            os,
+            "greyhound_read_canceled_total",
+            "counter",
+            "Read requests canceled by the client.",
+            m_readsCanceled);
+    metrics::write(
+            os,
+            "greyhound_write_points_total",
+            "counter",
+            "Points written by write requests.",
+            m_writePoints);
+
+    const double raw(m_rawBytes);
+    const double encoded(m_encodedBytes);
+
+    metrics::write(
+            os,
+            "greyhound_compression_raw_bytes_total",
+            "counter",
+            "Uncompressed bytes of measured compression.",
+            raw);
+    metrics::write(
+            os,
+            "greyhound_compression_encoded_bytes_total",
+            "counter",
+            "Compressed bytes of measured compression.",
+            encoded);
+    metrics::write(
+            os,
+            "greyhound_compression_ratio",
+            "gauge",
+            "Overall ratio of uncompressed to compressed bytes.",
+            encoded ? raw / encoded : 0);
+}
+
+namespace metrics
+{
+
+void write(
+        std::ostream& os,
+        const std::string& name,
+        const std::string& type,
+        const std::string& help,
+        const double value)
+{
+    header(os, name, type, help);
+    os << name << " " << number(value) << "\n";
+}
+
+} // namespace metrics
+
+} // namespace greyhound
+
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include <greyhound/logger.hpp>
+
+namespace greyhound
+{
+
+// A latency histogram with fixed buckets, updated without locking.
+class Histogram
+{
+public:
+    Histogram();
+
+    void observe(double seconds);
+
+    // Writes the series of a Prometheus histogram with the given name, where
+    // labels, if not empty, are of the form 'key="value"'.
+    void write(
+            std::ostream& os,
+            const std::string& name,
+            const std::string& labels) const;
+
+private:
+    static const std::size_t numBuckets = 14;
+    static const std::array<double, numBuckets> bounds;
+
+    // Counts are per-bucket, and accumulated when written.
+    std::array<std::atomic<uint64_t>, numBuckets + 1> m_counts;
+    std::atomic<uint64_t> m_micros;
+};
+
+// Request statistics gathered from access records.  Series describing other
+// components are written by the Manager, which owns them.
+class Metrics
+{
+public:
+    Metrics();
+
+    void record(const AccessRecord& record);
+
+    // Count a request that failed, which has no access record.
+    void error(HttpStatusCode code);
+
+    // Writes our series in the Prometheus text format.
+    void write(std::ostream& os) const;
+
+private:
+    static const std::size_t numRoutes = 6;
+
+    std::array<Histogram, numRoutes> m_latency;
+
+    std::atomic<uint64_t> m_readBytes;
+    std::atomic<uint64_t> m_readPoints;
+    std::atomic<uint64_t> m_readsCached;
+    std::atomic<uint64_t> m_readsCanceled;
+    std::atomic<uint64_t> m_writePoints;
+
+    std::atomic<uint64_t> m_clientErrors;
+    std::atomic<uint64_t> m_serverErrors;
+
+    // Only for compression whose output size is measured.
+    std::atomic<uint64_t> m_rawBytes;
+    std::atomic<uint64_t> m_encodedBytes;
+};
+
+namespace metrics
+{
+    // Write a single-valued series with its metadata.
+    void write(
+            std::ostream& os,
+            const std::string& name,
+            const std::string& type,
+            const std::string& help,
+            double value);
+}
+
+} // namespace greyhound
+
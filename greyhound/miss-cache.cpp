@@ -0,0 +1,49 @@
+#include <greyhound/miss-cache.hpp>
+
+namespace greyhound
+{
+
+MissCache::MissCache(
+        const std::size_t timeoutSeconds,
+        const std::size_t maxEntries)
+    : m_timeoutSeconds(timeoutSeconds)
+    , m_maxEntries(maxEntries)
+{ }
+
+bool MissCache::has(const std::string& name)
+{
+    if (!enabled()) return false;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it(m_entries.find(name));
+    if (it == m_entries.end()) return false;
+
+    if (secondsSince(it->second->second) < m_timeoutSeconds) return true;
+
+    m_list.erase(it->second);
+    m_entries.erase(it);
+    return false;
+}
+
+void MissCache::insert(const std::string& name)
+{
+    if (!enabled()) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it(m_entries.find(name));
+    if (it != m_entries.end()) m_list.erase(it->second);
+
+    m_list.emplace_front(name, getNow());
+    m_entries[name] = m_list.begin();
+
+    while (m_list.size() > m_maxEntries)
+    {
+        m_entries.erase(m_list.back().first);
+        m_list.pop_back();
+    }
+}
+
+} // namespace greyhound
+
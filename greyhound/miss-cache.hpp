@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// Remembers resource names recently found at none of our paths, so that
+// repeated requests for them fail immediately instead of probing every path
+// again.  Entries expire after a timeout, and beyond a maximum count the
+// oldest entries are dropped.
+class MissCache
+{
+public:
+    MissCache(std::size_t timeoutSeconds, std::size_t maxEntries = 4096);
+
+    bool has(const std::string& name);
+    void insert(const std::string& name);
+
+    bool enabled() const { return m_timeoutSeconds; }
+    std::size_t timeoutSeconds() const { return m_timeoutSeconds; }
+
+private:
+    using List = std::list<std::pair<std::string, TimePoint>>;
+
+    const std::size_t m_timeoutSeconds;
+    const std::size_t m_maxEntries;
+
+    // Most recently inserted entries are at the front.
+    List m_list;
+    std::map<std::string, List::iterator> m_entries;
+
+    std::mutex m_mutex;
+};
+
+} // namespace greyhound
+
@@ -0,0 +1,111 @@
+#include <greyhound/read-cache.hpp>
+
+namespace greyhound
+{
+
+ReadCache::ReadCache(const std::size_t maxBytes)
+    : m_maxBytes(maxBytes)
+{ }
+
+ReadCache::Entry ReadCache::get(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto it(m_entries.find(key));
+    if (it == m_entries.end())
+    {
+        ++m_misses;
+        return Entry();
+    }
+
+    ++m_hits;
+    m_list.splice(m_list.begin(), m_list, it->second);
+    return it->second->data;
+}
+
+void ReadCache::insert(
+        const std::string& key,
+        const std::vector<std::string>& readers,
+        Data data,
+        const std::size_t epoch)
+{
+    if (data.size() > maxEntryBytes()) return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& r : readers)
+    {
+        auto it(m_invalidated.find(r));
+        if (it != m_invalidated.end() && it->second > epoch) return;
+    }
+
+    auto it(m_entries.find(key));
+    if (it != m_entries.end()) erase(it->second);
+
+    m_bytes += data.size();
+    auto entry(std::make_shared<const Data>(std::move(data)));
+    m_list.push_front(Node{ key, entry, readers });
+    m_entries[key] = m_list.begin();
+    for (const auto& r : readers) m_byReader[r].insert(key);
+
+    while (m_bytes > m_maxBytes) erase(std::prev(m_list.end()));
+}
+
+void ReadCache::invalidate(const std::string& reader)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_invalidated[reader] = ++m_epoch;
+
+    auto rit(m_byReader.find(reader));
+    if (rit == m_byReader.end()) return;
+
+    // Copy the keys since erasing an entry modifies this set.
+    const std::set<std::string> keys(rit->second);
+    for (const auto& key : keys)
+    {
+        auto it(m_entries.find(key));
+        if (it != m_entries.end()) erase(it->second);
+    }
+}
+
+void ReadCache::erase(const List::iterator it)
+{
+    m_bytes -= it->data->size();
+
+    for (const auto& r : it->readers)
+    {
+        auto rit(m_byReader.find(r));
+        if (rit == m_byReader.end()) continue;
+        rit->second.erase(it->key);
+        if (rit->second.empty()) m_byReader.erase(rit);
+    }
+
+    m_entries.erase(it->key);
+    m_list.erase(it);
+}
+
+std::size_t ReadCache::epoch() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_epoch;
+}
+
+std::size_t ReadCache::bytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_bytes;
+}
+
+std::size_t ReadCache::hits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+std::size_t ReadCache::misses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+} // namespace greyhound
+
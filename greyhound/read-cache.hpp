@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// A byte-bounded LRU cache of complete response bodies, keyed by a
+// canonicalized query.  Each entry remembers the readers that produced it so a
+// change to any one of them can drop every response that might now be stale.
+// Used for both /read and /hierarchy responses.
+class ReadCache
+{
+public:
+    using Entry = std::shared_ptr<const Data>;
+
+    ReadCache(std::size_t maxBytes);
+
+    // Returns null on a miss.
+    Entry get(const std::string& key);
+
+    // The epoch must have been captured with epoch() before the response was
+    // built.  If any of its readers has been invalidated since then, the data
+    // may reflect a partial write, so it is discarded rather than inserted.
+    // Invalidations of other readers have no effect.
+    void insert(
+            const std::string& key,
+            const std::vector<std::string>& readers,
+            Data data,
+            std::size_t epoch);
+
+    void invalidate(const std::string& reader);
+
+    std::size_t epoch() const;
+    std::size_t bytes() const;
+    std::size_t hits() const;
+    std::size_t misses() const;
+
+    bool enabled() const { return m_maxBytes; }
+    std::size_t maxBytes() const { return m_maxBytes; }
+
+    // Don't let a single huge response evict the entire cache.
+    std::size_t maxEntryBytes() const { return m_maxBytes / 8; }
+
+private:
+    struct Node
+    {
+        std::string key;
+        Entry data;
+        std::vector<std::string> readers;
+    };
+
+    using List = std::list<Node>;
+
+    // Caller must hold m_mutex.
+    void erase(List::iterator it);
+
+    const std::size_t m_maxBytes;
+    std::size_t m_bytes = 0;
+    std::size_t m_epoch = 0;
+
+    // The epoch at which each reader was most recently invalidated.
+    std::map<std::string, std::size_t> m_invalidated;
+    std::size_t m_hits = 0;
+    std::size_t m_misses = 0;
+
+    // Most recently used entries are at the front.
+    List m_list;
+    std::map<std::string, List::iterator> m_entries;
+    std::map<std::string, std::set<std::string>> m_byReader;
+
+    mutable std::mutex m_mutex;
+};
+
+} // namespace greyhound
+
@@ -1,5 +1,10 @@
 #include <greyhound/resource.hpp>
 
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <set>
+
 #include <json/json.h>
 
 #include <pdal/compression/LazPerfCompression.hpp>
@@ -15,7 +20,15 @@
 #include <entwine/util/unique.hpp>
 
 #include <greyhound/chunker.hpp>
+#include <greyhound/codec.hpp>
+#include <greyhound/etag.hpp>
+#include <greyhound/file-index.hpp>
+#include <greyhound/framer.hpp>
+#include <greyhound/hierarchy.hpp>
+#include <greyhound/json.hpp>
+#include <greyhound/json-stream.hpp>
 #include <greyhound/manager.hpp>
+#include <greyhound/merger.hpp>
 
 namespace greyhound
 {
@@ -23,123 +36,409 @@ namespace greyhound
 namespace
 {
 
-std::string dense(const Json::Value& json)
+// Normalize a query so that equivalent queries - for example those with
+// differently formatted numbers or a "depth" rather than a depth range - map to
+// the same cache entry and entity tag.
+std::string canonicalQuery(Json::Value q)
 {
-    auto s = Json::FastWriter().write(json);
-    s.pop_back();
-    return s;
+    if (q.isMember("depth"))
+    {
+        const Json::UInt64 depth(q["depth"].asUInt64());
+        q.removeMember("depth");
+        q["depthBegin"] = depth;
+        q["depthEnd"] = depth + 1;
+    }
+    else
+    {
+        if (q.isMember("depthBegin"))
+        {
+            q["depthBegin"] = Json::UInt64(q["depthBegin"].asUInt64());
+        }
+        if (q.isMember("depthEnd"))
+        {
+            q["depthEnd"] = Json::UInt64(q["depthEnd"].asUInt64());
+        }
+    }
+
+    if (q.isMember("bounds"))
+    {
+        q["bounds"] = entwine::Bounds(q["bounds"]).toJson();
+    }
+
+    return dense(q);
 }
 
-template<typename Req> Json::Value parseQuery(Req& req)
+// Returns "laz" for laz-perf compression, the name of a general-purpose codec,
+// or an empty string for uncompressed data.
+std::string getCompression(const Json::Value& v)
 {
-    Json::Value q;
-    for (const auto& p : req.parse_query_string())
+    if (v.isString())
     {
-        q[p.first] = entwine::parse(p.second);
+        const std::string s(v.asString());
+        if (s == "laz" || s == "lazperf") return "laz";
+        if (!codec::isAvailable(s))
+        {
+            throw Http400("Compression not available: " + s);
+        }
+        return s;
     }
-    return q;
+
+    return v.asBool() ? "laz" : "";
 }
 
-enum class Color
+// Split [0, n) into contiguous ranges and call f(task, i) for each index,
+// with up to the given number of tasks running concurrently on the executor.
+// A single task runs inline.  The first error from any task is rethrown here.
+template<typename F>
+void parallelRanges(
+        Executor& executor,
+        const std::size_t n,
+        std::size_t tasks,
+        F f)
 {
-    Black,
-    Red,
-    Green,
-    Yellow,
-    Blue,
-    Magenta,
-    Cyan,
-    White
-};
+    tasks = std::max<std::size_t>(std::min(tasks, n), 1);
 
-const std::map<Color, std::string> colorCodes {
-    { Color::Black,     "\x1b[30m" },
-    { Color::Red,       "\x1b[31m" },
-    { Color::Green,     "\x1b[32m" },
-    { Color::Yellow,    "\x1b[33m" },
-    { Color::Blue,      "\x1b[34m" },
-    { Color::Magenta,   "\x1b[35m" },
-    { Color::Cyan,      "\x1b[36m" },
-    { Color::White,     "\x1b[37m" }
-};
+    if (tasks == 1)
+    {
+        for (std::size_t i(0); i < n; ++i) f(0, i);
+        return;
+    }
 
-std::string color(const std::string& s, Color c)
-{
-    return colorCodes.at(c) + s + "\x1b[0m";
+    TaskGroup group(executor);
+
+    for (std::size_t task(0); task < tasks; ++task)
+    {
+        const std::size_t begin(n * task / tasks);
+        const std::size_t end(n * (task + 1) / tasks);
+
+        group.add([&f, task, begin, end]()
+        {
+            for (std::size_t i(begin); i < end; ++i) f(task, i);
+        });
+    }
+
+    group.wait();
 }
 
 std::mutex m;
 
-} // unnamed namespace
+void logProbe(
+        const std::string& name,
+        const std::string& path,
+        const std::string& message)
+{
+    std::lock_guard<std::mutex> lock(m);
+    std::cout << "\t" << name << " at " << path << ": " << message <<
+        std::endl;
+}
 
-SharedReader& TimedReader::get()
+// State shared by the concurrent path probes of a single reader creation.
+struct Probes
 {
-    std::lock_guard<std::mutex> lock(m_mutex);
-    m_touched = getNow();
-    if (m_reader) return m_reader;
+    explicit Probes(std::size_t n)
+        : claimed(n, false)
+        , done(n, false)
+        , readers(n)
+        , errors(n)
+    { }
+
+    // Caller must hold the mutex.  The result is known once some path has
+    // succeeded and every path before it has failed, or once every path has
+    // failed, in which case the winner is the number of paths.
+    bool resolved(std::size_t& winner) const
+    {
+        for (std::size_t i(0); i < done.size(); ++i)
+        {
+            if (!done[i]) return false;
+            if (readers[i])
+            {
+                winner = i;
+                return true;
+            }
+        }
 
-    create();
+        winner = done.size();
+        return true;
+    }
 
-    if (!m_reader)
+    std::vector<bool> claimed;
+    std::vector<bool> done;
+    std::vector<SharedReader> readers;
+    std::vector<std::exception_ptr> errors;
+    bool canceled = false;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+// Append streamed output to the chunker's data.  A chunked response is only
+// started once there is more than one initial chunk of it, so that small
+// responses are still sent whole, with a Content-Length.
+template<typename Res>
+JsonStream::Sink chunkSink(Chunker<Res>& chunker)
+{
+    return [&chunker](const char* pos, std::size_t size)
     {
-        throw HttpError(
-                HttpStatusCode::client_error_not_found,
-                "Not found: " + m_name);
-    }
-    else return m_reader;
+        Data& data(chunker.data());
+        data.insert(data.end(), pos, pos + size);
+        if (data.size() >= chunking::initialBytes) chunker.write();
+        return !chunker.canceled();
+    };
 }
 
-void TimedReader::create()
+} // unnamed namespace
+
+SharedReader TimedReader::get()
 {
-    std::cout << "Creating " << m_name << std::endl;
+    // The touch time only drives sweeping, so it needs no ordering.
+    m_touched.store(getNow(), std::memory_order_relaxed);
+
+    if (SharedReader reader = std::atomic_load(&m_reader)) return reader;
+
+    std::promise<SharedReader> promise;
+    std::shared_future<SharedReader> future;
+    bool creator(false);
 
-    for (const auto& path : m_manager.paths())
     {
-        std::cout << "\tTrying " << path << ": ";
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (SharedReader reader = std::atomic_load(&m_reader)) return reader;
+
+        if (!m_creating.valid())
+        {
+            m_creating = promise.get_future().share();
+            creator = true;
+        }
+
+        future = m_creating;
+    }
 
+    if (creator)
+    {
         try
         {
-            entwine::arbiter::Endpoint ep(
-                    m_manager.outerScope().getArbiterPtr()->getEndpoint(
-                        entwine::arbiter::util::join(path, m_name)));
+            MissCache& missing(m_manager.missCache());
+            SharedReader reader;
+
+            // Transient failures are thrown rather than remembered, so only
+            // a resource that exists at none of our paths is recorded.
+            if (!missing.has(m_name))
+            {
+                reader = create();
+                if (!reader) missing.insert(m_name);
+            }
+
+            if (!reader)
+            {
+                throw HttpError(
+                        HttpStatusCode::client_error_not_found,
+                        "Not found: " + m_name);
+            }
 
-            entwine::arbiter::Endpoint tmp(
-                    m_manager.outerScope().getArbiterPtr()->getEndpoint(
-                        m_manager.config()["tmp"].asString()));
+            // Serializing the manifest may be expensive for large datasets,
+            // so do it once here rather than per request, and hash it as it
+            // is serialized rather than holding all of it as a string.
+            etag::Digest d;
+            JsonStream json([&d](const char* pos, std::size_t size)
+            {
+                d.update(pos, size);
+                return true;
+            });
+            json.value(reader->metadata().manifest().toJson());
+            json.done();
 
-            auto& cache(m_manager.cache());
+            auto digest(std::make_shared<const std::string>(d.hex()));
 
-            if (auto r = std::make_shared<entwine::Reader>(ep, tmp, cache))
             {
-                std::cout << "SUCCESS" << std::endl;
-                m_reader = r;
-                return;
+                std::lock_guard<std::mutex> lock(m_mutex);
+                std::atomic_store(&m_digest, digest);
+                std::atomic_store(&m_reader, reader);
+                m_creating = std::shared_future<SharedReader>();
             }
-            else std::cout << "fail - null result received" << std::endl;
+
+            promise.set_value(reader);
         }
-        catch (const std::exception& e)
+        catch (...)
         {
-            std::cout << "fail - " << e.what() << std::endl;
+            // Waiters for this creation share its failure, but the next call
+            // will try again.
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_creating = std::shared_future<SharedReader>();
+            }
+
+            promise.set_exception(std::current_exception());
         }
-        catch (...)
+    }
+
+    return future.get();
+}
+
+SharedReader TimedReader::create()
+{
+    std::cout << "Creating " << m_name << std::endl;
+
+    // After being swept, go straight back to where we were found.
+    if (m_path.size())
+    {
+        std::exception_ptr error;
+        if (SharedReader reader = create(m_path, error)) return reader;
+        m_path.clear();
+    }
+
+    const Paths& paths(m_manager.paths());
+    auto probes(std::make_shared<Probes>(paths.size()));
+
+    // Probes may outlive this call, so they refer only to long-lived state.
+    auto probe([this, probes](std::size_t i)
+    {
+        {
+            std::lock_guard<std::mutex> lock(probes->mutex);
+            if (probes->claimed[i] || probes->canceled) return;
+            probes->claimed[i] = true;
+        }
+
+        std::exception_ptr error;
+        SharedReader reader(create(m_manager.paths()[i], error));
+
         {
-            std::cout << "fail - unknown error" << std::endl;
+            std::lock_guard<std::mutex> lock(probes->mutex);
+            probes->readers[i] = reader;
+            probes->errors[i] = error;
+            probes->done[i] = true;
         }
+
+        probes->cv.notify_all();
+    });
+
+    for (std::size_t i(1); i < paths.size(); ++i)
+    {
+        m_manager.executor().post([probe, i]() { probe(i); });
     }
+
+    // Run any probes that no worker has started, in order of preference, so
+    // that we make progress even if every worker is busy.
+    std::size_t winner(paths.size());
+    std::unique_lock<std::mutex> lock(probes->mutex);
+
+    for (std::size_t i(0); i < paths.size(); ++i)
+    {
+        if (probes->resolved(winner)) break;
+
+        lock.unlock();
+        probe(i);
+        lock.lock();
+    }
+
+    probes->cv.wait(lock, [&]() { return probes->resolved(winner); });
+    probes->canceled = true;
+
+    if (winner == paths.size())
+    {
+        for (const auto& error : probes->errors)
+        {
+            if (error) std::rethrow_exception(error);
+        }
+
+        return SharedReader();
+    }
+
+    m_path = paths[winner];
+    return probes->readers[winner];
 }
 
-bool TimedReader::sweep()
+SharedReader TimedReader::create(
+        const std::string& path,
+        std::exception_ptr& error)
+{
+    try
+    {
+        entwine::arbiter::Endpoint ep(
+                m_manager.outerScope().getArbiterPtr()->getEndpoint(
+                    entwine::arbiter::util::join(path, m_name)));
+
+        // Only the absence of the metadata means that the resource does not
+        // exist here - failures to read it may be transient.
+        if (!ep.tryGetSize("entwine"))
+        {
+            logProbe(m_name, path, "fail - not found");
+            return SharedReader();
+        }
+
+        entwine::arbiter::Endpoint tmp(
+                m_manager.outerScope().getArbiterPtr()->getEndpoint(
+                    m_manager.config()["tmp"].asString()));
+
+        auto& cache(m_manager.cache());
+
+        if (auto r = std::make_shared<entwine::Reader>(ep, tmp, cache))
+        {
+            logProbe(m_name, path, "SUCCESS");
+            return r;
+        }
+        else logProbe(m_name, path, "fail - null result received");
+    }
+    catch (const std::exception& e)
+    {
+        logProbe(m_name, path, std::string("fail - ") + e.what());
+        error = std::current_exception();
+    }
+    catch (...)
+    {
+        logProbe(m_name, path, "fail - unknown error");
+        error = std::current_exception();
+    }
+
+    return SharedReader();
+}
+
+std::shared_ptr<const FileIndex> TimedReader::fileIndex(
+        const SharedReader& reader)
+{
+    if (auto index = std::atomic_load(&m_fileIndex)) return index;
+
+    // Build under a lock of our own, so that concurrent callers wait for a
+    // single build rather than each building an index.
+    std::lock_guard<std::mutex> lock(m_fileIndexMutex);
+    if (auto index = std::atomic_load(&m_fileIndex)) return index;
+
+    std::cout << "Indexing files of " << m_name << std::endl;
+    auto index(
+            std::make_shared<const FileIndex>(
+                reader->metadata().manifest()));
+    std::atomic_store(&m_fileIndex, index);
+    return index;
+}
+
+bool TimedReader::sweep(const bool force)
 {
     std::lock_guard<std::mutex> lock(m_mutex);
-    if (m_reader && secondsSince(m_touched) > m_manager.timeoutSeconds())
+    if (!force && secondsSince(touched()) <= m_manager.timeoutSeconds())
     {
-        std::cout << "Sweeping " << m_name << "..." << std::flush;
-        m_manager.cache().release(*m_reader);
-        m_reader.reset();
-        std::cout << " done" << std::endl;
-        return true;
+        return false;
+    }
+
+    // Take the reader out before checking for other references, since the
+    // lock-free path of get() may copy it at any time while it is published.
+    // Once unpublished, callers of get() wait on our lock instead.
+    const SharedReader reader(
+            std::atomic_exchange(&m_reader, SharedReader()));
+    if (!reader) return false;
+
+    // Beyond this copy, any references belong to requests.
+    if (reader.use_count() > 1)
+    {
+        std::atomic_store(&m_reader, reader);
+        return false;
     }
-    return false;
+
+    std::cout << "Sweeping " << m_name << "..." << std::flush;
+    std::atomic_store(&m_fileIndex, std::shared_ptr<const FileIndex>());
+    m_manager.cache().release(*reader);
+    m_manager.readCache().invalidate(m_name);
+    m_manager.hierarchyCache().invalidate(m_name);
+    ++m_version;
+    std::cout << " done" << std::endl;
+    return true;
 }
 
 Resource::Resource(
@@ -189,59 +488,148 @@ Json::Value Resource::infoSingle() const
 
 Json::Value Resource::infoMulti() const
 {
-    entwine::Schema schema;
-    entwine::Schema addons;
-    entwine::Bounds bounds(entwine::Bounds::expander());
-    entwine::Bounds boundsConforming(entwine::Bounds::expander());
-    std::set<std::string> srsList;
-    std::size_t numPoints(0);
-    std::size_t baseDepth(0);
-    double density(0);
-    entwine::Scale scale(1);
+    // Member readers may need to be created, which dominates the cost here,
+    // so reduce contiguous ranges of them concurrently and then combine those
+    // partial results in order.
+    struct Partial
+    {
+        entwine::Schema schema;
+        entwine::Schema addons;
+        entwine::Bounds bounds = entwine::Bounds::expander();
+        entwine::Bounds boundsConforming = entwine::Bounds::expander();
+        std::set<std::string> srsList;
+        std::size_t numPoints = 0;
+        std::size_t baseDepth = 0;
+        double density = 0;
+        entwine::Scale scale = entwine::Scale(1);
+
+        void add(const Partial& o)
+        {
+            schema = schema.merge(o.schema);
+            addons = addons.append(o.addons);
+            bounds.grow(o.bounds);
+            boundsConforming.grow(o.boundsConforming);
+            srsList.insert(o.srsList.begin(), o.srsList.end());
+            numPoints += o.numPoints;
+            baseDepth = std::max(baseDepth, o.baseDepth);
+            density = std::max(density, o.density);
+            scale = entwine::Point::min(scale, o.scale);
+        }
+    };
+
+    std::vector<Partial> partials(
+            std::min(m_manager.threads(), m_readers.size()));
 
-    for (const auto& tr : m_readers)
+    parallelRanges(
+            m_manager.executor(),
+            m_readers.size(),
+            partials.size(),
+            [this, &partials](std::size_t task, std::size_t i)
     {
-        auto r(tr->get());
+        Partial& p(partials[task]);
+        auto r(m_readers[i]->get());
 
         const auto& meta(r->metadata());
-        schema = schema.merge(meta.schema());
-        for (const auto& a : r->appends()) addons = addons.append(a.second);
-        bounds.grow(meta.boundsNativeCubic());
-        boundsConforming.grow(meta.boundsNativeConforming());
-        if (!meta.srs().empty()) srsList.insert(meta.srs());
-        numPoints += meta.manifest().pointStats().inserts();
-        baseDepth = std::max(baseDepth, meta.structure().baseDepthBegin());
-        density = std::max(density, meta.density());
+        p.schema = p.schema.merge(meta.schema());
+        for (const auto& a : r->appends()) p.addons = p.addons.append(a.second);
+        p.bounds.grow(meta.boundsNativeCubic());
+        p.boundsConforming.grow(meta.boundsNativeConforming());
+        if (!meta.srs().empty()) p.srsList.insert(meta.srs());
+        p.numPoints += meta.manifest().pointStats().inserts();
+        p.baseDepth = std::max(p.baseDepth, meta.structure().baseDepthBegin());
+        p.density = std::max(p.density, meta.density());
         if (const auto d = meta.delta())
         {
-            scale = entwine::Point::min(scale, d->scale());
+            p.scale = entwine::Point::min(p.scale, d->scale());
         }
-    }
+    });
+
+    Partial total;
+    for (const Partial& p : partials) total.add(p);
 
     Json::Value json;
     json["type"] = "octree";
-    json["schema"] = schema.toJson();
-    for (const entwine::DimInfo dim : addons.dims())
+    json["schema"] = total.schema.toJson();
+    for (const entwine::DimInfo dim : total.addons.dims())
     {
         Json::Value j(dim.toJson());
         j["addon"] = true;
         json["schema"].append(j);
     }
-    json["bounds"] = bounds.cubeify().toJson();
-    json["numPoints"] = Json::UInt64(numPoints);
-    json["boundsConforming"] = boundsConforming.toJson();
-    if (srsList.size() == 1) json["srs"] = *srsList.begin();
-    json["baseDepth"] = Json::UInt64(baseDepth);
+    json["bounds"] = total.bounds.cubeify().toJson();
+    json["numPoints"] = Json::UInt64(total.numPoints);
+    json["boundsConforming"] = total.boundsConforming.toJson();
+    if (total.srsList.size() == 1) json["srs"] = *total.srsList.begin();
+    json["baseDepth"] = Json::UInt64(total.baseDepth);
 
     // if (const auto r = meta.reprojection()) json["reprojection"] = r->toJson();
-    if (density) json["density"] = density;
-    if (scale != entwine::Scale(1)) json["scale"] = scale.toJson();
+    if (total.density) json["density"] = total.density;
+    if (total.scale != entwine::Scale(1)) json["scale"] = total.scale.toJson();
 
     return json;
 }
 
+Resource::SharedInfo Resource::getInfo() const
+{
+    // Info is requested for every /info call and every /read without an
+    // explicit schema, so hold onto it until one of our readers is swept or
+    // has its appends changed.
+    std::vector<std::size_t> versions;
+    for (const TimedReader* tr : m_readers) versions.push_back(tr->version());
+
+    {
+        std::lock_guard<std::mutex> lock(m_infoMutex);
+        if (m_info && versions == m_infoVersions) return m_info;
+    }
+
+    auto info(std::make_shared<Info>());
+    info->json = isSingle() ? infoSingle() : infoMulti();
+    info->styled = info->json.toStyledString();
+    info->schema = std::make_shared<entwine::Schema>(info->json["schema"]);
+    for (const Json::Value& dim : info->json["schema"])
+    {
+        if (dim["addon"].asBool()) info->addons.insert(dim["name"].asString());
+    }
+
+    std::lock_guard<std::mutex> lock(m_infoMutex);
+    m_info = info;
+    m_infoVersions = versions;
+    return info;
+}
+
+bool Resource::hasAddons(const entwine::Schema& schema) const
+{
+    const SharedInfo info(getInfo());
+    const auto& dims(schema.dims());
+
+    return std::any_of(
+            dims.begin(),
+            dims.end(),
+            [&info](const entwine::DimInfo& dim)
+            {
+                return info->addons.count(dim.name());
+            });
+}
+
+std::string Resource::readVersion(const bool addons) const
+{
+    std::string version;
+    for (const TimedReader* tr : m_readers) version += tr->digest() + "/";
+
+    if (!addons) return version;
+
+    version += m_manager.instance();
+    for (const TimedReader* tr : m_readers)
+    {
+        const std::size_t begun(tr->writesBegun());
+        if (tr->writesDone() != begun) return std::string();
+        version += "/" + std::to_string(begun);
+    }
+    return version;
+}
+
 template<typename Req, typename Res>
-void Resource::info(Req& req, Res& res)
+void Resource::info(Req& req, Res& res, Timing& timing)
 {
     const auto start(getNow());
 
@@ -252,16 +640,17 @@ void Resource::info(Req& req, Res& res)
     h.erase("Cache-Control");
     h.emplace("Cache-Control", "public, max-age=1");
     h.emplace("Content-Type", "application/json");
-    res.write(getInfo().toStyledString(), h);
+    const std::string& styled(getInfo()->styled);
+    h.emplace("Server-Timing", timing.header());
+    res.write(styled, h);
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("info", Color::Green) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms" <<
-        std::endl;
+    AccessRecord record(Route::Info, m_name, start);
+    record.setTiming(timing);
+    m_manager.report(record);
 }
 
 template<typename Req, typename Res>
-void Resource::hierarchy(Req& req, Res& res)
+void Resource::hierarchy(Req& req, Res& res, Timing& timing)
 {
     const auto start(getNow());
 
@@ -270,31 +659,131 @@ void Resource::hierarchy(Req& req, Res& res)
         throw std::runtime_error("Hierarchy not allowed for multi-resource");
     }
 
-    const Json::Value q(parseQuery(req));
-    const Json::Value result(m_readers.front()->get()->hierarchy(q));
+    Json::Value q(parseQuery(req));
+    TimedReader& tr(*m_readers.front());
+
+    // The format is applied here rather than within the query.
+    const std::string format(
+            q.isMember("format") ? q["format"].asString() : "json");
+    q.removeMember("format");
+
+    if (format != "json" && format != "binary")
+    {
+        throw Http400("Invalid hierarchy format: " + format);
+    }
+    if (format == "binary" && q["vertical"].asBool())
+    {
+        throw Http400("Binary hierarchy format cannot be vertical");
+    }
+
+    // The hierarchy is unaffected by appended dimensions, so it is identified
+    // by the indexed data and the query alone.  Aliases of the same reader
+    // share entries.
+    const std::string digest(tr.digest());
+    const std::string query(canonicalQuery(q) + "/" + format);
+    const std::string key(digest + "/" + query);
+    const std::string tag(etag::make(digest, query));
+
     auto h(m_manager.headers());
-    h.emplace("Content-Type", "application/json");
-    res.write(dense(result), h);
+    h.emplace("ETag", tag);
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("hier", Color::Yellow) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms ";
+    // Revalidations need no work at all beyond the query normalization.
+    if (etag::notModified(req, tag))
+    {
+        h.emplace("Server-Timing", timing.header());
+        res.write(HttpStatusCode::redirection_not_modified, h);
+
+        AccessRecord record(Route::Hierarchy, m_name, start);
+        record.setDepth(q);
+        record.cached = true;
+        record.setTiming(timing);
+        m_manager.report(record);
+        return;
+    }
 
-    std::cout << "D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
+    h.emplace(
+            "Content-Type",
+            format == "binary" ? "binary/octet-stream" : "application/json");
 
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
+    Chunker<Res> chunker(res, h);
+    chunker.trailer("Server-Timing", [&timing, &chunker]()
+    {
+        timing.set(Timing::Stage::Send, chunker.blockedSeconds());
+        return timing.header();
+    });
+
+    ReadCache& cache(m_manager.hierarchyCache());
+    const std::size_t epoch(cache.epoch());
+    bool fromCache(false);
 
-    std::cout << ")" << std::endl;
+    if (const auto hit = cache.enabled() ? cache.get(key) : nullptr)
+    {
+        chunker.writeAll(hit->data(), hit->size());
+        fromCache = true;
+    }
+    else
+    {
+        SharedReader reader(tr.get());
+
+        Json::Value result;
+        {
+            Timing::Scope scope(timing, Timing::Stage::Query);
+            result = reader->hierarchy(q);
+        }
+
+        // Retain a copy of the response for the cache as it is streamed,
+        // unless it grows too large to be cached.
+        bool cacheable(cache.enabled());
+        Data cached;
+        const JsonStream::Sink send(chunkSink(chunker));
+
+        auto sink([&](const char* pos, std::size_t size)
+        {
+            if (cacheable && cached.size() + size <= cache.maxEntryBytes())
+            {
+                cached.insert(cached.end(), pos, pos + size);
+            }
+            else if (cacheable)
+            {
+                cacheable = false;
+                Data().swap(cached);
+            }
+            return send(pos, size);
+        });
+
+        if (format == "binary")
+        {
+            const Data binary(hierarchy::toBinary(result));
+            sink(binary.data(), binary.size());
+        }
+        else
+        {
+            JsonStream json(sink);
+            json.value(result);
+            json.done();
+        }
+
+        if (!chunker.canceled())
+        {
+            chunker.write(true);
+            if (cacheable)
+            {
+                cache.insert(key, { tr.name() }, std::move(cached), epoch);
+            }
+        }
+    }
+
+    AccessRecord record(Route::Hierarchy, m_name, start);
+    record.setDepth(q);
+    record.bytes = chunker.bytes();
+    record.cached = fromCache;
+    record.canceled = chunker.canceled();
+    record.setTiming(timing);
+    m_manager.report(record);
 }
 
 template<typename Req, typename Res>
-void Resource::files(Req& req, Res& res)
+void Resource::files(Req& req, Res& res, Timing& timing)
 {
     const auto start(getNow());
 
@@ -324,38 +813,91 @@ void Resource::files(Req& req, Res& res)
         else throw Http400("Cannot specify an OriginId and a query");
     }
 
-    if (query.isNull())
+    if (!query.isNull() && !query.isObject())
     {
-        // For a root-level /files query, return a JSON array of all paths.
-        const auto paths(reader->metadata().manifest().paths());
-        res.write(dense(entwine::toJsonArray(paths)), h);
+        throw Http400("Invalid files query");
     }
-    else if (query.isObject())
+    if (query.isMember("bounds") && query.isMember("search"))
     {
-        Json::Value result;
+        throw Http400("Invalid query - cannot specify bounds and search");
+    }
+
+    // Results may cover millions of files, so they are streamed as they are
+    // walked rather than built up and serialized in full.
+    Chunker<Res> chunker(res, h);
+    chunker.trailer("Server-Timing", [&timing, &chunker]()
+    {
+        timing.set(Timing::Stage::Send, chunker.blockedSeconds());
+        return timing.header();
+    });
+
+    JsonStream json(chunkSink(chunker));
+
+    if (query.isNull())
+    {
+        // For a root-level /files query, return a JSON array of all paths.
+        const auto& files(reader->metadata().manifest().fileInfo());
 
-        if (query.isMember("bounds") && query.isMember("search"))
+        json.beginArray();
+        for (const auto& f : files)
         {
-            throw Http400("Invalid query - cannot specify bounds and search");
+            if (json.canceled()) break;
+            json.value(f.path());
         }
+        json.endArray();
+    }
+    else if (query.isMember("bounds"))
+    {
+        const entwine::Bounds bounds(query["bounds"]);
 
-        if (query.isMember("bounds"))
+        // Queries in a local coordinate system are left to entwine, which
+        // transforms them.  Otherwise our index avoids a manifest scan.
+        entwine::FileInfoList transformed;
+        std::vector<const entwine::FileInfo*> files;
         {
-            const entwine::Bounds bounds(query["bounds"]);
+            Timing::Scope scope(timing, Timing::Stage::Query);
 
             if (auto delta = entwine::Delta::maybeCreate(query))
             {
-                result = toJson(
-                        reader->files(
-                            bounds,
-                            &delta->scale(),
-                            &delta->offset()));
+                transformed = reader->files(
+                        bounds,
+                        &delta->scale(),
+                        &delta->offset());
+                for (const auto& f : transformed) files.push_back(&f);
+            }
+            else
+            {
+                const auto& all(reader->metadata().manifest().fileInfo());
+                const auto index(m_readers.front()->fileIndex(reader));
+                for (const auto o : index->find(bounds))
+                {
+                    files.push_back(&all[o]);
+                }
             }
-            else result = toJson(reader->files(bounds));
         }
-        else if (query.isMember("search"))
+
+        // As before, no matching files is a null result.
+        if (files.empty()) json.value(Json::Value());
+        else
         {
-            auto single([&reader](const Json::Value& v)->Json::Value
+            json.beginArray();
+            for (const entwine::FileInfo* f : files)
+            {
+                if (json.canceled()) break;
+                json.value(f->toJson());
+            }
+            json.endArray();
+        }
+    }
+    else
+    {
+        Json::Value result;
+
+        if (query.isMember("search"))
+        {
+            const auto index(m_readers.front()->fileIndex(reader));
+
+            auto single([&reader, &index](const Json::Value& v)->Json::Value
             {
                 if (v.isIntegral())
                 {
@@ -364,7 +906,16 @@ void Resource::files(Req& req, Res& res)
                 }
                 else if (v.isString())
                 {
-                    try { return reader->files(v.asString()).toJson(); }
+                    // An exact path is found by our index, and anything else
+                    // by entwine's search of the manifest.
+                    const std::string s(v.asString());
+                    const entwine::Origin* origin(index->find(s));
+
+                    try
+                    {
+                        if (origin) return reader->files(*origin).toJson();
+                        else return reader->files(s).toJson();
+                    }
                     catch (...) { return Json::nullValue; }
                 }
                 else throw Http400("Invalid files query");
@@ -375,124 +926,375 @@ void Resource::files(Req& req, Res& res)
             else for (const auto& v : search) result.append(single(v));
         }
 
-        res.write(dense(result), h);
+        json.value(result);
     }
-    else throw Http400("Invalid files query");
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("file", Color::Green) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms " <<
-        "Q: " << (root.size() ? root : dense(query)) <<
-        std::endl;
+    json.done();
+    if (!chunker.canceled()) chunker.write(true);
+
+    AccessRecord record(Route::Files, m_name, start);
+    record.setFilter(root.size() ? root : dense(query));
+    record.bytes = chunker.bytes();
+    record.canceled = chunker.canceled();
+    record.setTiming(timing);
+    m_manager.report(record);
 }
 
 template<typename Req, typename Res>
-void Resource::read(Req& req, Res& res)
+void Resource::read(Req& req, Res& res, Timing& timing)
 {
     const auto start(getNow());
 
     Json::Value q(parseQuery(req));
 
-    if (!q.isMember("schema")) q["schema"] = getInfo()["schema"];
+    // The merge mode only affects the order of multi-resource output, so it
+    // is not forwarded to the queries themselves.
+    const Merger::Mode mode(Merger::mode(q));
+    q.removeMember("merge");
+
+    // Likewise, compression is applied here rather than within the query.
+    // With no explicit compression, a codec may be negotiated from the
+    // Accept-Encoding header, in which case it is a true content-encoding.
+    Headers headers(m_manager.headers());
+    std::string compression(getCompression(q["compress"]));
+    const bool framed(compression == "laz" && q["framed"].asBool());
+
+    if (
+            !q.isMember("compress") &&
+            m_manager.negotiateEncoding() &&
+            codec::available().size())
+    {
+        headers.emplace("Vary", "Accept-Encoding");
 
-    std::unique_ptr<pdal::LazPerfCompressor> compressor;
-    std::vector<char> compressed;
+        const auto it(req.header.find("Accept-Encoding"));
+        if (it != req.header.end())
+        {
+            compression = codec::negotiate(it->second);
+            if (compression.size())
+            {
+                headers.emplace("Content-Encoding", compression);
+            }
+        }
+    }
 
-    if (q.isMember("compress") && q["compress"].asBool())
+    q.removeMember("compress");
+    q.removeMember("framed");
+
+    // Normalize a client-supplied schema so equivalent spellings share a read
+    // cache entry.  Otherwise use our native schema, which is already built.
+    std::shared_ptr<const entwine::Schema> schema;
+    if (q.isMember("schema"))
+    {
+        schema = std::make_shared<entwine::Schema>(q["schema"]);
+        q["schema"] = schema->toJson();
+    }
+    else
     {
-        const entwine::Schema schema(q["schema"]);
-        const auto dimTypes(schema.pdalLayout().dimTypes());
-        auto cb([&compressed](char* p, std::size_t s)
+        const SharedInfo info(getInfo());
+        q["schema"] = info->json["schema"];
+        schema = info->schema;
+    }
+
+    // Interleaved output is not deterministic, so it is identified by neither
+    // a read cache entry nor an entity tag.
+    const bool deterministic(isSingle() || mode == Merger::Mode::Ordered);
+    const std::string query(
+            canonicalQuery(q) + "/" + compression + (framed ? "/framed" : ""));
+
+    const bool addons(hasAddons(*schema));
+    const std::string version(deterministic ? readVersion(addons) : "");
+
+    if (version.size())
+    {
+        const std::string tag(etag::make(version, query));
+        headers.emplace("ETag", tag);
+
+        if (!addons && m_manager.immutableMaxAge())
         {
-            compressed.insert(compressed.end(), p, p + s);
-        });
-        compressor = entwine::makeUnique<pdal::LazPerfCompressor>(cb, dimTypes);
+            headers.erase("Cache-Control");
+            headers.emplace(
+                    "Cache-Control",
+                    "public, max-age=" +
+                        std::to_string(m_manager.immutableMaxAge()) +
+                        ", immutable");
+        }
+
+        // Revalidations are answered before any query runs.
+        if (etag::notModified(req, tag))
+        {
+            headers.emplace("Server-Timing", timing.header());
+            res.write(HttpStatusCode::redirection_not_modified, headers);
+
+            AccessRecord record(Route::Read, m_name, start);
+            record.cached = true;
+            record.setTiming(timing);
+            m_manager.report(record);
+            return;
+        }
     }
 
-    Chunker<Res> chunker(res, m_manager.headers());
+    Chunker<Res> chunker(res, headers);
     auto& data(chunker.data());
 
+    chunker.trailer("Server-Timing", [&timing, &chunker]()
+    {
+        timing.set(Timing::Stage::Send, chunker.blockedSeconds());
+        return timing.header();
+    });
+
     uint32_t points(0);
 
-    for (std::size_t i(0); i < m_readers.size(); ++i)
+    ReadCache& cache(m_manager.readCache());
+    const std::size_t epoch(cache.epoch());
+    // Keyed by version as well, so that a rebuilt resource never serves bytes
+    // cached from its previous contents under its new entity tag.
+    const std::string key(
+            cache.enabled() && version.size() ?
+                m_name + "/" + version + query : "");
+    bool cacheable(!key.empty());
+    Data cached;
+
+    if (cacheable)
+    {
+        if (const auto hit = cache.get(key))
+        {
+            chunker.writeAll(hit->data(), hit->size());
+
+            AccessRecord record(Route::Read, m_name, start);
+            record.bytes = hit->size();
+            record.cached = true;
+            record.setTiming(timing);
+            m_manager.report(record);
+            return;
+        }
+    }
+
+    // Retain a copy of the response for the read cache, unless it grows too
+    // large to be cached.
+    auto collect([&](const char* pos, std::size_t size)
     {
-        TimedReader* reader(m_readers.at(i));
-        auto query(reader->get()->getQuery(q));
-        const bool last(i == m_readers.size() - 1);
+        if (!cacheable) return;
 
-        while (!query->done() && !chunker.canceled())
+        if (cached.size() + size <= cache.maxEntryBytes())
         {
-            query->next();
-            const bool allDone(last && query->done());
+            cached.insert(cached.end(), pos, pos + size);
+        }
+        else
+        {
+            cacheable = false;
+            Data().swap(cached);
+        }
+    });
+
+    std::unique_ptr<pdal::LazPerfCompressor> compressor;
+    std::unique_ptr<Encoder> encoder;
+    std::unique_ptr<Framer> framer;
+
+    // Track compression throughput for the log.
+    std::size_t rawBytes(0);
+    std::size_t compressedBytes(0);
+
+    // Compress directly into the outbound chunk.
+    auto sink([&data, &collect, &compressedBytes](const char* p, std::size_t s)
+    {
+        data.insert(data.end(), p, p + s);
+        collect(p, s);
+        compressedBytes += s;
+    });
+
+    if (framed)
+    {
+        // Compress each batch independently and concurrently.
+        framer = entwine::makeUnique<Framer>(*schema, m_manager.executor());
+    }
+    else if (compression == "laz")
+    {
+        const auto dimTypes(schema->pdalLayout().dimTypes());
+        compressor = entwine::makeUnique<pdal::LazPerfCompressor>(
+                sink,
+                dimTypes);
+    }
+    else if (compression.size())
+    {
+        encoder = Encoder::create(
+                compression,
+                sink,
+                m_manager.config()["zstdLevel"].asInt());
+    }
+
+    Data frame;
+    auto emitFrame([&](bool wait)->bool
+    {
+        if (!framer->next(frame, wait)) return false;
+        collect(frame.data(), frame.size());
+        chunker.append(frame);
+        return true;
+    });
 
-            auto& qdata(query->data());
+    auto emit([&](Data& qdata, bool allDone)
+    {
+        rawBytes += qdata.size();
+        const auto compressStart(getNow());
+
+        if (framer)
+        {
+            if (qdata.size())
+            {
+                while (framer->full()) emitFrame(true);
+                framer->push(qdata);
+            }
 
-            if (compressor)
+            // Emit whatever is ready, or everything once we are done.
+            while (emitFrame(allDone)) { }
+        }
+        else if (encoder)
+        {
+            if (qdata.size()) encoder->encode(qdata.data(), qdata.size());
+            qdata.clear();
+        }
+        else if (compressor)
+        {
+            if (qdata.size())
             {
                 compressor->compress(qdata.data(), qdata.size());
-                if (allDone) compressor->done();
-                data.insert(data.end(), compressed.begin(), compressed.end());
-                compressed.clear();
+            }
+            if (allDone) compressor->done();
+            qdata.clear();
+        }
+        else
+        {
+            // Hand the query's buffer to the chunker rather than copying it.
+            // The query continues with a recycled buffer.
+            collect(qdata.data(), qdata.size());
+            chunker.append(qdata);
+        }
+
+        if (allDone)
+        {
+            // Our codecs wrap the entire response, so the decoded result is
+            // identical to an uncompressed response.
+            const char* pos(reinterpret_cast<const char*>(&points));
+            if (encoder)
+            {
+                encoder->encode(pos, sizeof(uint32_t));
+                encoder->done();
             }
             else
             {
-                data.insert(data.end(), qdata.begin(), qdata.end());
+                data.insert(data.end(), pos, pos + sizeof(uint32_t));
+                collect(pos, sizeof(uint32_t));
             }
+        }
 
-            qdata.clear();
+        if (compressor || encoder || framer)
+        {
+            timing.add(Timing::Stage::Compress, compressStart);
+        }
 
-            if (query->done()) points += query->numPoints();
+        chunker.write(allDone);
+    });
 
-            if (allDone)
+    if (isSingle())
+    {
+        SharedReader reader(m_readers.front()->get());
+        auto query(reader->getQuery(q));
+
+        while (!query->done() && !chunker.canceled())
+        {
             {
-                const char* pos(reinterpret_cast<const char*>(&points));
-                data.insert(data.end(), pos, pos + sizeof(uint32_t));
+                Timing::Scope scope(timing, Timing::Stage::Query);
+                query->next();
             }
 
-            chunker.write(allDone);
+            if (query->done()) points += query->numPoints();
+            emit(query->data(), query->done());
         }
     }
+    else
+    {
+        // Run the member queries concurrently, merging their output into our
+        // single stream.
+        Merger merger(m_readers, q, mode, m_manager.merges());
+        Data qdata;
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("read", Color::Cyan) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms";
+        auto next([&]()
+        {
+            Timing::Scope scope(timing, Timing::Stage::Query);
+            return merger.next(qdata);
+        });
 
-    std::cout << " D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
+        while (!chunker.canceled() && next()) emit(qdata, false);
 
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
+        if (!chunker.canceled())
+        {
+            points = merger.points();
+            emit(qdata, true);
+        }
+    }
 
-    std::cout << ")";
-    std::cout << " P: " << points;
+    if (cacheable && !cached.empty() && !chunker.canceled())
+    {
+        std::vector<std::string> names;
+        for (const TimedReader* r : m_readers) names.push_back(r->name());
+        cache.insert(key, names, std::move(cached), epoch);
+    }
 
-    if (q.isMember("filter")) std::cout << " F: " << dense(q["filter"]);
-    if (chunker.canceled()) std::cout << " " << color("canceled", Color::Red);
+    AccessRecord record(Route::Read, m_name, start);
+    record.setDepth(q);
+    record.points = points;
+    if (q.isMember("filter")) record.setFilter(dense(q["filter"]));
+
+    if (compression.size())
+    {
+        record.setCompression(compression, framed);
+        record.rawBytes = rawBytes;
 
-    std::cout << std::endl;
+        // Framed compression happens concurrently, so it is not measured.
+        if (!framer)
+        {
+            record.encodedBytes = compressedBytes;
+            record.encodeSeconds = timing.get(Timing::Stage::Compress);
+        }
+    }
+
+    timing.set(Timing::Stage::Send, chunker.blockedSeconds());
+
+    record.bytes = chunker.bytes();
+    record.canceled = chunker.canceled();
+    record.setTiming(timing);
+    m_manager.report(record);
 }
 
 template<typename Req, typename Res>
-void Resource::count(Req& req, Res& res)
+void Resource::count(Req& req, Res& res, Timing& timing)
 {
     const auto start(getNow());
 
-    uint64_t points(0);
-    uint64_t chunks(0);
-
     const Json::Value q(parseQuery(req));
 
-    for (TimedReader* reader : m_readers)
+    std::vector<uint64_t> taskPoints(
+            std::min(m_manager.threads(), m_readers.size()), 0);
+    std::vector<uint64_t> taskChunks(taskPoints.size(), 0);
+
+    const auto queryStart(getNow());
+    parallelRanges(
+            m_manager.executor(),
+            m_readers.size(),
+            taskPoints.size(),
+            [&](std::size_t task, std::size_t i)
     {
-        auto query(reader->get()->getCountQuery(q));
+        SharedReader reader(m_readers[i]->get());
+        auto query(reader->getCountQuery(q));
         query->run();
-        points += query->numPoints();
-        chunks += query->chunks();
-    }
+        taskPoints[task] += query->numPoints();
+        taskChunks[task] += query->chunks();
+    });
+    timing.add(Timing::Stage::Query, queryStart);
+
+    uint64_t points(0);
+    uint64_t chunks(0);
+    for (const auto n : taskPoints) points += n;
+    for (const auto n : taskChunks) chunks += n;
 
     Json::Value result;
     result["points"] = static_cast<Json::UInt64>(points);
@@ -500,32 +1302,19 @@ void Resource::count(Req& req, Res& res)
 
     auto h(m_manager.headers());
     h.emplace("Content-Type", "application/json");
+    h.emplace("Server-Timing", timing.header());
     res.write(dense(result), h);
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("count", Color::Cyan) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms";
-
-    std::cout << " D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
-
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
-
-    std::cout << ")";
-    std::cout << " P: " << points;
-
-    if (q.isMember("filter")) std::cout << " F: " << dense(q["filter"]);
-
-    std::cout << std::endl;
+    AccessRecord record(Route::Count, m_name, start);
+    record.setDepth(q);
+    record.points = points;
+    if (q.isMember("filter")) record.setFilter(dense(q["filter"]));
+    record.setTiming(timing);
+    m_manager.report(record);
 }
 
 template<typename Req, typename Res>
-void Resource::write(Req& req, Res& res)
+void Resource::write(Req& req, Res& res, Timing& timing)
 {
     if (!m_manager.config()["allowWrite"].asBool())
     {
@@ -538,9 +1327,22 @@ void Resource::write(Req& req, Res& res)
 
     const std::string name(q["name"].asString());
     SharedReader reader(m_readers.front()->get());
+    TimedReader::Writing writing(*m_readers.front());
     const entwine::Schema schema(q["schema"]);
 
-    if (schema.pointSize()) reader->registerAppend(name, schema);
+    if (schema.pointSize())
+    {
+        // Only a new or changed addon affects our info, so avoid discarding
+        // it for every write to an already-registered addon.
+        const auto& appends(reader->appends());
+        const auto it(appends.find(name));
+        const bool changed(
+                it == appends.end() ||
+                it->second.toJson() != schema.toJson());
+
+        reader->registerAppend(name, schema);
+        if (changed) m_readers.front()->invalidate();
+    }
 
     const std::size_t size(req.content.size());
 
@@ -551,61 +1353,120 @@ void Resource::write(Req& req, Res& res)
             std::istreambuf_iterator<char>());
     if (data.size() != size) throw std::runtime_error("Invalid size");
 
-    if (q.isMember("compress") && q["compress"].asBool())
+    // Payloads may be laz-perf compressed, in which case the point count is
+    // required, or wrapped in a general-purpose codec specified either by the
+    // compress parameter or by a Content-Encoding header.
+    std::string compression(getCompression(q["compress"]));
+    if (!q.isMember("compress"))
+    {
+        const auto it(req.header.find("Content-Encoding"));
+        if (it != req.header.end() && it->second != "identity")
+        {
+            compression = it->second;
+            std::transform(
+                    compression.begin(),
+                    compression.end(),
+                    compression.begin(),
+                    ::tolower);
+        }
+    }
+
+    // Decoding requires the point size, and is bounded so that a small
+    // payload cannot inflate without bound.
+    if (compression.size() && !schema.pointSize())
+    {
+        throw Http400("A schema is required for compressed writes");
+    }
+
+    const std::size_t maxBytes(m_manager.writeSizeLimit());
+    const auto decodeStart(getNow());
+
+    if (compression == "laz")
     {
         std::size_t np(0);
         const auto npIt(req.header.find("NumPoints"));
         if (npIt != req.header.end()) np = std::stoull(npIt->second);
         else throw std::runtime_error("NumPoints header is missing");
 
+        if (np > maxBytes / schema.pointSize())
+        {
+            throw HttpError(
+                    HttpStatusCode::client_error_payload_too_large,
+                    "Decoded size exceeds " + std::to_string(maxBytes) +
+                        " bytes");
+        }
+
         if (const auto d = entwine::Compression::decompress(data, schema, np))
         {
             data = std::move(*d);
         }
         else throw std::runtime_error("Could not decompress buffer");
     }
+    else if (compression.size())
+    {
+        data = codec::decode(compression, data, maxBytes);
 
-    const std::size_t points(reader->write(name, data, q));
-
-    res.write("", m_manager.headers());
+        if (data.size() % schema.pointSize())
+        {
+            throw Http400("Decoded size is not a multiple of the point size");
+        }
+    }
 
-    if (!points) return;
+    if (compression.size()) timing.add(Timing::Stage::Compress, decodeStart);
 
-    std::lock_guard<std::mutex> lock(m);
-    std::cout << m_name << "/" << color("write", Color::Yellow) << ": " <<
-        color(std::to_string(msSince(start)), Color::Magenta) << " ms";
+    const std::size_t decodedSize(data.size());
 
-    std::cout << " D: [";
-    if (q.isMember("depthBegin")) std::cout << q["depthBegin"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt();
-    else std::cout << "all";
+    // Any cached reads of this resource may be stale after this write, even
+    // if it fails partway through.
+    std::size_t points(0);
+    ReadCache& cache(m_manager.readCache());
+    const auto queryStart(getNow());
+    try
+    {
+        points = reader->write(name, data, q);
+    }
+    catch (...)
+    {
+        cache.invalidate(m_readers.front()->name());
+        throw;
+    }
+    cache.invalidate(m_readers.front()->name());
+    timing.add(Timing::Stage::Query, queryStart);
 
-    std::cout << ", ";
-    if (q.isMember("depthEnd")) std::cout << q["depthEnd"].asUInt();
-    else if (q.isMember("depth")) std::cout << q["depth"].asUInt() + 1;
-    else std::cout << "all";
+    auto h(m_manager.headers());
+    h.emplace("Server-Timing", timing.header());
+    res.write("", h);
 
-    std::cout << ")";
-    std::cout << " P: " << points;
+    AccessRecord record(Route::Write, m_name, start);
+    record.setDepth(q);
+    record.points = points;
+    if (q.isMember("filter")) record.setFilter(dense(q["filter"]));
 
-    if (q.isMember("filter")) std::cout << " F: " << dense(q["filter"]);
+    if (compression.size() && compression != "laz")
+    {
+        record.setCompression(compression, false);
+        record.rawBytes = decodedSize;
+        record.encodedBytes = size;
+        record.encodeSeconds = timing.get(Timing::Stage::Compress);
+    }
 
-    std::cout << std::endl;
+    record.setTiming(timing);
+    m_manager.report(record);
 }
 
-template void Resource::info(Http::Request&, Http::Response&);
-template void Resource::hierarchy(Http::Request&, Http::Response&);
-template void Resource::files(Http::Request&, Http::Response&);
-template void Resource::read(Http::Request&, Http::Response&);
-template void Resource::count(Http::Request&, Http::Response&);
-template void Resource::write(Http::Request&, Http::Response&);
-
-template void Resource::info(Https::Request&, Https::Response&);
-template void Resource::hierarchy(Https::Request&, Https::Response&);
-template void Resource::files(Https::Request&, Https::Response&);
-template void Resource::read(Https::Request&, Https::Response&);
-template void Resource::count(Https::Request&, Https::Response&);
-template void Resource::write(Https::Request&, Https::Response&);
+template void Resource::info(Http::Request&, Http::Response&, Timing&);
+template void Resource::hierarchy(Http::Request&, Http::Response&, Timing&);
+template void Resource::files(Http::Request&, Http::Response&, Timing&);
+template void Resource::read(Http::Request&, Http::Response&, Timing&);
+template void Resource::count(Http::Request&, Http::Response&, Timing&);
+template void Resource::write(Http::Request&, Http::Response&, Timing&);
+
+template void Resource::info(Https::Request&, Https::Response&, Timing&);
+template void Resource::hierarchy(Https::Request&, Https::Response&, Timing&);
+template void Resource::files(Https::Request&, Https::Response&, Timing&);
+template void Resource::read(Https::Request&, Https::Response&, Timing&);
+template void Resource::count(Https::Request&, Https::Response&, Timing&);
+template void Resource::write(Https::Request&, Https::Response&, Timing&);
 
 } // namespace greyhound
 
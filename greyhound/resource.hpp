@@ -1,15 +1,26 @@
 #pragma once
 
+#include <atomic>
+#include <exception>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <set>
+#include <string>
 
 #include <greyhound/defs.hpp>
+#include <greyhound/timing.hpp>
 
-namespace entwine { class Reader; }
+namespace entwine
+{
+    class Reader;
+    class Schema;
+}
 
 namespace greyhound
 {
 
+class FileIndex;
 class Manager;
 
 using SharedReader = std::shared_ptr<entwine::Reader>;
@@ -21,23 +32,105 @@ public:
         : m_manager(manager)
         , m_name(name)
         , m_touched(getNow())
+        , m_version(0)
+        , m_writesBegun(0)
+        , m_writesDone(0)
     { }
 
     const std::string& name() const { return m_name; }
-    SharedReader& get();
-    bool sweep();
+
+    // Callers should hold the result for as long as they use the reader, so
+    // that it is not swept out from under them.  A loaded reader is returned
+    // without locking.  Otherwise, the first caller creates it while any
+    // concurrent callers wait for - and share - the result of that creation,
+    // including its failure.
+    SharedReader get();
+
+    // Release our reader if it has been idle for longer than the resource
+    // timeout, or regardless of idle time if forced.  A reader that is held
+    // by a request or is busy being created is never released.  Returns true
+    // if the reader was released.
+    bool sweep(bool force = false);
+
+    TimePoint touched() const
+    {
+        return m_touched.load(std::memory_order_relaxed);
+    }
+
+    bool loaded() const
+    {
+        return static_cast<bool>(std::atomic_load(&m_reader));
+    }
+
+    // Incremented whenever results derived from this reader may have changed,
+    // either by it being swept or by its set of appended dimensions changing.
+    std::size_t version() const { return m_version; }
+    void invalidate() { ++m_version; }
+
+    // Indexes of the files of the reader, which must be our current one.
+    // They are built on first use and released along with the reader, so the
+    // reader must be held for as long as they are used.
+    std::shared_ptr<const FileIndex> fileIndex(const SharedReader& reader);
+
+    // Writes are counted as they begin and as they end, so that reads may
+    // tell whether the appended data has changed or is changing.
+    std::size_t writesBegun() const { return m_writesBegun; }
+    std::size_t writesDone() const { return m_writesDone; }
+
+    class Writing
+    {
+    public:
+        explicit Writing(TimedReader& tr) : m_tr(tr) { ++m_tr.m_writesBegun; }
+        ~Writing() { ++m_tr.m_writesDone; }
+
+    private:
+        TimedReader& m_tr;
+    };
+
+    // A digest of the manifest of the most recently created reader, which
+    // identifies the indexed data independently of our process, so it
+    // changes only if the resource is rebuilt.  Empty until first created.
+    std::string digest() const
+    {
+        const auto d(std::atomic_load(&m_digest));
+        return d ? *d : std::string();
+    }
 
 private:
-    void create();
-    void reset();
+    // Probe our paths concurrently, preferring the earliest one at which the
+    // resource exists, and returns null if there is none.  If it was not
+    // found but some path failed for another reason, such as a timeout, that
+    // failure is rethrown since the resource may yet exist.
+    SharedReader create();
+
+    // Returns null if the resource was not created at this path, in which
+    // case the error is set unless the resource definitely does not exist.
+    SharedReader create(const std::string& path, std::exception_ptr& error);
 
     Manager& m_manager;
     std::string m_name;
 
-    TimePoint m_touched;
+    // Only accessed atomically.
+    std::atomic<TimePoint> m_touched;
     SharedReader m_reader;
-
+    std::shared_ptr<const std::string> m_digest;
+    std::shared_ptr<const FileIndex> m_fileIndex;
+    std::atomic_size_t m_version;
+    std::atomic_size_t m_writesBegun;
+    std::atomic_size_t m_writesDone;
+
+    // Guards the transitions of m_reader, and m_creating, which is valid
+    // while a creation is in flight.
     mutable std::mutex m_mutex;
+    std::shared_future<SharedReader> m_creating;
+
+    // Guards the creation of m_fileIndex, which is otherwise only accessed
+    // atomically.
+    std::mutex m_fileIndexMutex;
+
+    // The path at which our reader was last created.  Only accessed by the
+    // creator of an in-flight creation.
+    std::string m_path;
 };
 
 class Resource
@@ -50,12 +143,18 @@ public:
 
     std::vector<TimedReader*>& readers() { return m_readers; }
 
-    template<typename Req, typename Res> void info(Req& req, Res& res);
-    template<typename Req, typename Res> void hierarchy(Req& req, Res& res);
-    template<typename Req, typename Res> void files(Req& req, Res& res);
-    template<typename Req, typename Res> void read(Req& req, Res& res);
-    template<typename Req, typename Res> void count(Req& req, Res& res);
-    template<typename Req, typename Res> void write(Req& req, Res& res);
+    template<typename Req, typename Res>
+    void info(Req& req, Res& res, Timing& timing);
+    template<typename Req, typename Res>
+    void hierarchy(Req& req, Res& res, Timing& timing);
+    template<typename Req, typename Res>
+    void files(Req& req, Res& res, Timing& timing);
+    template<typename Req, typename Res>
+    void read(Req& req, Res& res, Timing& timing);
+    template<typename Req, typename Res>
+    void count(Req& req, Res& res, Timing& timing);
+    template<typename Req, typename Res>
+    void write(Req& req, Res& res, Timing& timing);
 
     template<typename Req, typename Res> void infoMulti(Req& req, Res& res);
     template<typename Req, typename Res> void readMulti(Req& req, Res& res);
@@ -64,10 +163,19 @@ public:
 
     bool isSingle() const { return m_readers.size() == 1; }
     bool isMulti() const { return !isSingle(); }
-    Json::Value getInfo() const
+    // Info along with values derived from it, which remain valid until one
+    // of our readers is swept or has its appended dimensions changed.
+    struct Info
     {
-        return isSingle() ? infoSingle() : infoMulti();
-    }
+        Json::Value json;
+        std::string styled;
+        std::shared_ptr<const entwine::Schema> schema;
+        std::set<std::string> addons;
+    };
+
+    using SharedInfo = std::shared_ptr<const Info>;
+
+    SharedInfo getInfo() const;
 
 private:
     const Manager& m_manager;
@@ -76,6 +184,20 @@ private:
 
     Json::Value infoSingle() const;
     Json::Value infoMulti() const;
+
+    // True if the schema includes any of our appended dimensions, which may
+    // be written at any time.  Reads without them depend only on the indexed
+    // data, so they are immutable unless the resource is rebuilt.
+    bool hasAddons(const entwine::Schema& schema) const;
+
+    // Identifies the data that a read may return, or is empty if that data is
+    // being written.  Appended data is identified by counts of writes, which
+    // are only meaningful within this process.
+    std::string readVersion(bool addons) const;
+
+    mutable std::mutex m_infoMutex;
+    mutable SharedInfo m_info;
+    mutable std::vector<std::size_t> m_infoVersions;
 };
 
 using SharedResource = std::shared_ptr<Resource>;
@@ -1,9 +1,11 @@
 #pragma once
 
-#include <entwine/util/pool.hpp>
+#include <condition_variable>
+#include <mutex>
 
 #include <greyhound/defs.hpp>
 #include <greyhound/manager.hpp>
+#include <greyhound/timing.hpp>
 
 namespace greyhound
 {
@@ -21,7 +23,6 @@ public:
     Router(Manager& manager, unsigned int port, Args&&... args)
         : m_manager(manager)
         , m_server(std::forward<Args>(args)...)
-        , m_pool(m_manager.threads())
     {
         m_server.config.port = port;
         m_server.config.timeout_request = 0;
@@ -53,6 +54,17 @@ public:
     template<typename F>
     void put(std::string match, F f) { route("PUT", match, f); }
 
+    // Routes that do not refer to a resource.  These run directly on the
+    // server's thread, so they must be cheap.
+    template<typename F>
+    void direct(std::string method, std::string match, F f)
+    {
+        m_server.resource[match][method] = [f](ResPtr res, ReqPtr req)
+        {
+            f(*req, *res);
+        };
+    }
+
     template<typename F>
     void route(std::string method, std::string match, F f)
     {
@@ -60,10 +72,19 @@ public:
         {
             // res->close_connection_after_response = true;
 
-            m_pool.add([this, &f, req, res]() mutable
             {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                ++m_active;
+            }
+
+            m_manager.requests().post([this, &f, req, res]() mutable
+            {
+                Timing timing;
+
                 auto error(
-                        [this, &res](HttpStatusCode code, std::string message)
+                        [this, &res, &timing](
+                            HttpStatusCode code,
+                            std::string message)
                 {
                     // Don't cache errors.  This is a multi-map, so remove any
                     // existing Cache-Control setting.
@@ -75,15 +96,18 @@ public:
                     }
 
                     h.emplace("Cache-Control", "public, max-age=0");
+                    h.emplace("Server-Timing", timing.header());
                     res->write(code, message, h);
+
+                    m_manager.reportError(code);
                 });
 
                 try
                 {
                     const std::string name(req->path_match[1]);
-                    if (auto resource = m_manager.get(name, *req))
+                    if (auto resource = m_manager.get(name, *req, timing))
                     {
-                        f(*resource, *req, *res);
+                        f(*resource, *req, *res, timing);
                     }
                     else
                     {
@@ -113,20 +137,31 @@ public:
                 res.reset();
                 req.reset();
 
-                m_manager.sweep();
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_active;
+                m_cv.notify_all();
             });
         };
     }
 
     void start() { m_server.start(); }
-    void stop() { m_server.stop(); m_pool.join(); }
+    void stop()
+    {
+        m_server.stop();
+
+        // Our requests run on the manager's request pool, which outlives us.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return !m_active; });
+    }
     unsigned int port() const { return m_server.config.port; }
 
 private:
     Manager& m_manager;
     S m_server;
 
-    entwine::Pool m_pool;
+    std::size_t m_active = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
 };
 
 } // namespace greyhound
@@ -0,0 +1,42 @@
+#include <greyhound/timing.hpp>
+
+#include <sstream>
+
+namespace greyhound
+{
+
+std::string Timing::header() const
+{
+    std::ostringstream os;
+    os.setf(std::ios::fixed);
+    os.precision(3);
+
+    for (std::size_t i(0); i < numStages; ++i)
+    {
+        if (m_seconds[i] > 0)
+        {
+            os << toString(static_cast<Stage>(i)) << ";dur=" <<
+                m_seconds[i] * 1000.0 << ", ";
+        }
+    }
+
+    const std::chrono::duration<double> total(getNow() - m_start);
+    os << "total;dur=" << total.count() * 1000.0;
+    return os.str();
+}
+
+std::string toString(const Timing::Stage stage)
+{
+    switch (stage)
+    {
+        case Timing::Stage::Auth:       return "auth";
+        case Timing::Stage::Create:     return "create";
+        case Timing::Stage::Query:      return "query";
+        case Timing::Stage::Compress:   return "compress";
+        case Timing::Stage::Send:       return "send";
+    }
+    return "";
+}
+
+} // namespace greyhound
+
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <greyhound/defs.hpp>
+
+namespace greyhound
+{
+
+// The time a request spends in each stage of its handling, carried from the
+// router through to the handler.  A request is handled by a single thread, so
+// this is not synchronized.
+class Timing
+{
+public:
+    enum class Stage : uint8_t
+    {
+        Auth,       // Waiting on the authentication server or cache.
+        Create,     // Creating or touching readers.
+        Query,      // Running queries, including waiting on merged ones.
+        Compress,   // Compressing responses or decompressing writes.
+        Send        // Blocked while the client drains a streamed response.
+    };
+
+    static const std::size_t numStages = 5;
+
+    // Adds the time from construction until destruction to a stage.
+    class Scope
+    {
+    public:
+        Scope(Timing& timing, Stage stage)
+            : m_timing(timing)
+            , m_stage(stage)
+            , m_start(getNow())
+        { }
+
+        ~Scope() { m_timing.add(m_stage, m_start); }
+
+    private:
+        Timing& m_timing;
+        const Stage m_stage;
+        const TimePoint m_start;
+    };
+
+    Timing() : m_start(getNow()) { m_seconds.fill(0); }
+
+    void add(Stage stage, double seconds)
+    {
+        m_seconds[index(stage)] += seconds;
+    }
+
+    // Adds the time elapsed since the given start.
+    void add(Stage stage, TimePoint start)
+    {
+        const std::chrono::duration<double> d(getNow() - start);
+        add(stage, d.count());
+    }
+
+    void set(Stage stage, double seconds) { m_seconds[index(stage)] = seconds; }
+    double get(Stage stage) const { return m_seconds[index(stage)]; }
+
+    TimePoint start() const { return m_start; }
+
+    // A Server-Timing header value listing, in milliseconds, each stage that
+    // took any time, along with the total time so far.
+    std::string header() const;
+
+private:
+    static std::size_t index(Stage stage)
+    {
+        return static_cast<std::size_t>(stage);
+    }
+
+    const TimePoint m_start;
+    std::array<double, numStages> m_seconds;
+};
+
+std::string toString(Timing::Stage stage);
+
+} // namespace greyhound
+
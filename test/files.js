@@ -188,5 +188,54 @@ describe('files', () => {
             done();
         });
     });
+
+    it('returns file info by exact path', (done) => {
+        chai.request(server).get(resource + '/files')
+        .end((err, res) => {
+            var path = res.body[3];
+            chai.request(server).get(
+                    resource + '/files?search=' + JSON.stringify(path))
+            .end((err, res) => {
+                res.should.have.status(200);
+                check(res.body, null, null);
+                res.body.path.should.equal(path);
+                done();
+            });
+        });
+    });
+
+    it('returns overlapping files for bounds queries', (done) => {
+        chai.request(server).get(resource + '/info')
+        .end((err, res) => {
+            var b = res.body.bounds;
+            var mid = b.slice(0, 3).map((v, i) => (v + b[i + 3]) / 2);
+            var q = [b[0], b[1], b[2], mid[0], mid[1], mid[2]];
+
+            chai.request(server).get(
+                    resource + '/files?bounds=' + JSON.stringify(b))
+            .end((err, res) => {
+                res.should.have.status(200);
+                res.body.should.be.an('array');
+                res.body.should.have.lengthOf(8);
+
+                chai.request(server).get(
+                        resource + '/files?bounds=' + JSON.stringify(q))
+                .end((err, res) => {
+                    res.should.have.status(200);
+                    res.body.should.be.an('array');
+                    res.body.length.should.be.within(1, 8);
+                    res.body.forEach((v, i) => {
+                        check(v);
+                        if (i) v.origin.should.be.above(res.body[i - 1].origin);
+                        expect(v.bounds[0]).to.be.at.most(q[3]);
+                        expect(v.bounds[1]).to.be.at.most(q[4]);
+                        expect(v.bounds[3]).to.be.at.least(q[0]);
+                        expect(v.bounds[4]).to.be.at.least(q[1]);
+                    });
+                    done();
+                });
+            });
+        });
+    });
 });
 
@@ -0,0 +1,113 @@
+var common = require('./common');
+var server = common.server;
+var resource = common.resource;
+var util = require('./util');
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+var expect = chai.expect;
+chai.use(chaiHttp);
+
+var path = resource + '/hierarchy?depthBegin=6&depthEnd=10';
+
+describe('hierarchy', () => {
+    it('has an ETag', (done) => {
+        chai.request(server).get(path)
+        .end((err, res) => {
+            res.should.have.status(200);
+            expect(res.header.etag).to.match(/^"[0-9a-f]{16}"$/);
+            done();
+        });
+    });
+
+    it('has the same ETag for equivalent queries', (done) => {
+        chai.request(server).get(path)
+        .end((err, a) => {
+            chai.request(server)
+            .get(resource + '/hierarchy?depthEnd=10.0&depthBegin=6')
+            .end((err, b) => {
+                b.should.have.status(200);
+                expect(b.header.etag).to.equal(a.header.etag);
+                expect(b.body).to.deep.equal(a.body);
+                done();
+            });
+        });
+    });
+
+    it('has different ETags for different queries', (done) => {
+        chai.request(server).get(path)
+        .end((err, a) => {
+            chai.request(server)
+            .get(resource + '/hierarchy?depthBegin=6&depthEnd=9')
+            .end((err, b) => {
+                b.should.have.status(200);
+                expect(b.header.etag).to.not.equal(a.header.etag);
+                done();
+            });
+        });
+    });
+
+    it('responds to a matching If-None-Match with 304', (done) => {
+        chai.request(server).get(path)
+        .end((err, a) => {
+            chai.request(server).get(path)
+            .set('If-None-Match', 'W/"0123456789abcdef", ' + a.header.etag)
+            .end((err, b) => {
+                b.should.have.status(304);
+                expect(b.header.etag).to.equal(a.header.etag);
+                done();
+            });
+        });
+    });
+
+    it('matches the JSON hierarchy in binary format', (done) => {
+        chai.request(server).get(path)
+        .end((err, json) => {
+            chai.request(server).get(path + '&format=binary')
+            .buffer()
+            .parse(util.parseBinary)
+            .end((err, res) => {
+                res.should.have.status(200);
+                expect(res.header.etag).to.not.equal(json.header.etag);
+
+                var view = new DataView(res.body);
+                expect(view.getUint32(0, true)).to.equal(1);
+
+                var numNodes = view.getUint32(4, true);
+                expect(res.body.byteLength).to.equal(8 + numNodes * 8);
+
+                // Walk the JSON tree breadth-first alongside the nodes.
+                var dirs = ['swd', 'sed', 'nwd', 'ned',
+                            'swu', 'seu', 'nwu', 'neu'];
+                var queue = [json.body];
+                for (var i = 0; i < numNodes; ++i) {
+                    var node = queue.shift();
+                    var lo = view.getUint32(8 + i * 8, true);
+                    var hi = view.getUint32(8 + i * 8 + 4, true);
+                    expect(lo + (hi & 0xffffff) * 0x100000000)
+                        .to.equal(node.n);
+
+                    var mask = 0;
+                    dirs.forEach((d, b) => {
+                        if (node[d]) { mask |= 1 << b; queue.push(node[d]); }
+                    });
+                    expect(hi >>> 24).to.equal(mask);
+                }
+                expect(queue.length).to.equal(0);
+                done();
+            });
+        });
+    });
+
+    it('ignores a stale If-None-Match', (done) => {
+        chai.request(server).get(path)
+        .set('If-None-Match', '"0123456789abcdef"')
+        .end((err, res) => {
+            res.should.have.status(200);
+            expect(res.body).to.be.an('object');
+            done();
+        });
+    });
+});
+
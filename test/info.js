@@ -17,6 +17,20 @@ describe('info', () => {
         });
     });
 
+    it('404s repeated requests for nonexistent resources', (done) => {
+        var path = '/resource/i-do-not-exist-either/info';
+        chai.request(server).get(path)
+        .end((err, res) => {
+            res.should.have.status(404);
+
+            chai.request(server).get(path)
+            .end((err, res) => {
+                res.should.have.status(404);
+                done();
+            });
+        });
+    });
+
     it('returns JSON metadata', (done) => {
         chai.request(server).get(resource + '/info')
         .end((err, res) => {
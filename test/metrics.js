@@ -0,0 +1,45 @@
+var common = require('./common');
+var server = common.server;
+var resource = common.resource;
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+chai.use(chaiHttp);
+
+describe('metrics', () => {
+    it('reports requests in the Prometheus text format', (done) => {
+        chai.request(server).get(resource + '/info')
+        .end((err, res) => {
+            res.should.have.status(200);
+
+            chai.request(server).get('/metrics')
+            .end((err, res) => {
+                res.should.have.status(200);
+                res.should.have.header('content-type', /^text\/plain/);
+
+                var count = 'greyhound_request_duration_seconds_count';
+                res.text.should.match(
+                        new RegExp(count + '{route="info"} [1-9]'));
+                res.text.should.match(/greyhound_readers_loaded [1-9]/);
+                done();
+            });
+        });
+    });
+
+    it('counts failed requests', (done) => {
+        chai.request(server).get('/resource/i-do-not-exist/info')
+        .end((err, res) => {
+            res.should.have.status(404);
+
+            chai.request(server).get('/metrics')
+            .end((err, res) => {
+                res.should.have.status(200);
+                res.text.should.match(
+                        /greyhound_request_errors_total{class="4xx"} [1-9]/);
+                done();
+            });
+        });
+    });
+});
+
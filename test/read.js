@@ -200,6 +200,37 @@ describe('read', () => {
         });
     });
 
+    it('frames independently compressed batches', (done) => {
+        var schema = util.xyz;
+        var query = { schema: schema, depthEnd: 12 };
+
+        Promise.all([
+            util.read(query),
+            util.read(Object.assign({ compress: true, framed: true }, query))
+        ])
+        .then((results) => {
+            results[0].should.have.status(200);
+            results[1].should.have.status(200);
+
+            var expected = util.numPointsFrom(results[0].body, schema);
+
+            var view = new DataView(results[1].body);
+            var end = results[1].body.byteLength - 4;
+            var offset = 0;
+            var numPoints = 0;
+
+            while (offset < end) {
+                numPoints += view.getUint32(offset, true);
+                offset += 8 + view.getUint32(offset + 4, true);
+            }
+
+            expect(offset).to.equal(end);
+            expect(numPoints).to.equal(expected);
+            expect(view.getUint32(end, true)).to.equal(expected);
+            done();
+        });
+    });
+
     it('zeroes out unrecognized dimensions', (done) => {
         var schema = [
             { name: 'X', type: 'floating', size: 4 },
@@ -229,5 +260,41 @@ describe('read', () => {
             done();
         });
     });
+
+    it('has an ETag that depends on the query', (done) => {
+        var schema = util.xyz;
+        Promise.all([
+            util.read({ schema: schema, depth: 4 }),
+            util.read({ schema: schema, depthBegin: 4, depthEnd: 5 }),
+            util.read({ schema: schema, depth: 5 })
+        ])
+        .then((results) => {
+            results.forEach((res) => res.should.have.status(200));
+
+            var tags = results.map((res) => res.header.etag);
+            expect(tags[0]).to.match(/^"[0-9a-f]{16}"$/);
+            expect(tags[1]).to.equal(tags[0]);
+            expect(tags[2]).to.not.equal(tags[0]);
+            done();
+        });
+    });
+
+    it('responds to a matching If-None-Match with 304', (done) => {
+        var path = resource + '/read?depth=4&schema=' +
+            JSON.stringify(util.xyz);
+
+        util.read({ schema: util.xyz, depth: 4 })
+        .then((a) => {
+            a.should.have.status(200);
+
+            chai.request(server).get(path)
+            .set('If-None-Match', a.header.etag)
+            .end((err, b) => {
+                b.should.have.status(304);
+                expect(b.header.etag).to.equal(a.header.etag);
+                done();
+            });
+        });
+    });
 });
 
@@ -0,0 +1,18 @@
+var common = require('./common');
+var server = common.server;
+
+var chai = require('chai');
+var chaiHttp = require('chai-http');
+var should = chai.should();
+chai.use(chaiHttp);
+
+describe('ready', () => {
+    it('is ready without any resources to prewarm', (done) => {
+        chai.request(server).get('/ready')
+        .end((err, res) => {
+            res.should.have.status(200);
+            done();
+        });
+    });
+});
+
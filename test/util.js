@@ -118,6 +118,7 @@ var getSize = (name, schema) => {
 module.exports = {
     toArrayBuffer: toArrayBuffer,
     toString: toString,
+    parseBinary: parseBinary,
     pointSizeFrom: pointSizeFrom,
     numPointsFrom: numPointsFrom,
     split: split,
@@ -175,3 +175,69 @@ describe('write', () => {
 });
 */
 
+
+describe('codec write', () => {
+    // A single-segment zstd frame holding one raw block of two bytes.
+    var zstdFrame = () => {
+        var b = new Uint8Array([
+            0x28, 0xb5, 0x2f, 0xfd, 0x20, 0x02, 0x11, 0x00, 0x00, 0x01, 0x00
+        ]);
+        return b.buffer;
+    };
+
+    it('decodes zstd payloads', (done) => {
+        util.write({
+            name: 'testing-codec',
+            schema: writeSchema,
+            compress: 'zstd'
+        }, zstdFrame())
+        .then((res) => {
+            res.should.have.status(200);
+            done();
+        })
+        .catch((err) => done(err));
+    });
+
+    it('400s codec writes without a schema', (done) => {
+        util.write({ compress: 'zstd' }, zstdFrame())
+        .then((res) => {
+            res.should.have.status(400);
+            done();
+        })
+        .catch((err) => done(err));
+    });
+});
+
+describe('versioned reads', () => {
+    it('changes the ETag of addon reads after a write', (done) => {
+        var query = {
+            name: 'testing-version',
+            schema: writeSchema
+        };
+        var readQuery = { schema: util.xyz.concat(writeSchema), depth: 4 };
+        var tag;
+
+        util.write(query)
+        .then((res) => {
+            res.should.have.status(200);
+            return util.read(readQuery);
+        })
+        .then((res) => {
+            res.should.have.status(200);
+            tag = res.header.etag;
+            expect(tag).to.match(/^"[0-9a-f]{16}"$/);
+            return util.write(query);
+        })
+        .then((res) => {
+            res.should.have.status(200);
+            return util.read(readQuery);
+        })
+        .then((res) => {
+            res.should.have.status(200);
+            expect(res.header.etag).to.not.equal(tag);
+            done();
+        })
+        .catch((err) => done(err));
+    });
+});
+